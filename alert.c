@@ -0,0 +1,258 @@
+//included libraries
+#include "config.h"
+#include <string.h>
+#include "hal.h"
+#include "alert.h"
+#include "sms.h"
+#include "gsm.h"
+#include "eeprom.h"
+#include "audit.h"
+#include "timer.h"
+#include "tick.h"
+#include "telem.h"
+
+//recipient record, flag byte then the number, 0 terminated if it is shorter
+//than ALERT_RECORD - 1, slot 0 with an erased flag is CONTACT_NUMBER
+#define ALERT_ON 0xA5
+#define ALERT_OFF 0x5A
+
+#if ALERT_BASE < AUDIT_BASE + AUDIT_RECORDS * AUDIT_RECORD
+#error "alert recipients overlap the audit log"
+#endif
+#if ALERT_BASE + ALERT_RECIPIENTS * ALERT_RECORD > 0x400
+#error "alert recipients do not fit the 1 kB EEPROM"
+#endif
+#if ALERT_RECORD > SMS_NUMBER
+#error "alert recipient does not fit the AT+CMGS command"
+#endif
+
+//states, ALERT_GATHER and ALERT_HOLD wait for ALERT_timer, ALERT_WAIT for the
+//modem, ALERT_SENDING for the modem or for the timer of the next try
+#define ALERT_IDLE 0
+#define ALERT_GATHER 1
+#define ALERT_WAIT 2
+#define ALERT_SENDING 3
+#define ALERT_HOLD 4
+
+static const char ALERT_contact[] HAL_FLASH = CONTACT_NUMBER;
+static const char ALERT_names[ALERT_KINDS][40] HAL_FLASH = {
+	"System blocked after 3 wrong passwords", "Power cut while blocked"
+};
+
+static unsigned char ALERT_count[ALERT_KINDS]; //alerts of the next message
+static unsigned char ALERT_state;
+static unsigned char ALERT_ready; //modem configured
+static unsigned char ALERT_recipient; //slot the message goes to
+static unsigned char ALERT_tries; //failed sends to this recipient
+static char ALERT_number[SMS_NUMBER];
+static char ALERT_cmgs[SMS_CMGS];
+static char ALERT_text[ALERT_TEXT + 2]; //message, Ctrl-Z and 0
+static unsigned long ALERT_start; //send queued at, for the telemetry
+static struct TIMER ALERT_timer;
+
+static void ALERT_tick(unsigned char arg);
+
+void ALERT_init(void){
+	memset(ALERT_count, 0, sizeof(ALERT_count));
+	ALERT_state = ALERT_IDLE;
+	ALERT_ready = 0;
+	TIMER_setup(&ALERT_timer, ALERT_tick, 0);
+}
+
+static int ALERT_addr(unsigned char slot){
+	return ALERT_BASE + slot * ALERT_RECORD;
+}
+
+static unsigned char ALERT_load(unsigned char slot){
+	
+	//ALERT_load() reads the number of a recipient into ALERT_number, returns
+	//0 if the slot has none
+	
+	unsigned char flag = EEPROM_read(ALERT_addr(slot)), i;
+	if(slot == 0 && flag == 0xFF){
+		for(i = 0; (ALERT_number[i] = HAL_flash_byte(ALERT_contact + i)) != 0; i++);
+		return 1;
+	}
+	if(flag != ALERT_ON){
+		return 0;
+	}
+	for(i = 0; i < ALERT_RECORD - 1; i++){
+		ALERT_number[i] = EEPROM_read(ALERT_addr(slot) + 1 + i);
+		if(ALERT_number[i] == 0){
+			break;
+		}
+	}
+	ALERT_number[i] = 0;
+	return i != 0;
+}
+
+static void ALERT_append(const char* text, unsigned char flash, unsigned char* len){
+	char c;
+	while((c = flash ? HAL_flash_byte(text) : *text) != 0 && *len < ALERT_TEXT){
+		ALERT_text[(*len)++] = c;
+		text++;
+	}
+}
+
+static void ALERT_compose(void){
+	
+	//ALERT_compose() writes the counted alerts into ALERT_text, one line per
+	//kind with the count if it happened more than once, and clears the counts
+	
+	char digits[5];
+	unsigned char len = 0, kind, i;
+	ALERT_append(HAL_PSTR("Alert:"), 1, &len);
+	for(kind = 0; kind < ALERT_KINDS; kind++){
+		if(ALERT_count[kind] == 0){
+			continue;
+		}
+		ALERT_append(HAL_PSTR("\r"), 1, &len); //new line indication=carriage return
+		ALERT_append(ALERT_names[kind], 1, &len);
+		if(ALERT_count[kind] > 1){
+			i = sizeof(digits) - 1;
+			digits[i] = 0;
+			do{
+				digits[--i] = '0' + ALERT_count[kind] % 10;
+				ALERT_count[kind] /= 10;
+			}
+			while(ALERT_count[kind] != 0);
+			ALERT_append(HAL_PSTR(" x"), 1, &len);
+			ALERT_append(digits + i, 0, &len);
+		}
+		ALERT_count[kind] = 0;
+	}
+	ALERT_text[len] = 0x1A; //end of text, send SMS
+	ALERT_text[len + 1] = 0;
+}
+
+static void ALERT_sent(unsigned char result);
+
+static void ALERT_try(void){
+	ALERT_state = ALERT_SENDING;
+	ALERT_start = TICK_now();
+	if(!SMS_send(ALERT_cmgs, ALERT_number, ALERT_text, 0, ALERT_sent)){
+		ALERT_sent(GSM_ABORTED); //AT command queue full, counts as a failed try
+	}
+}
+
+static void ALERT_next(void){
+	
+	//ALERT_next() sends the message to the next recipient, after the last one
+	//the hold-off starts
+	
+	while(++ALERT_recipient < ALERT_RECIPIENTS){
+		if(ALERT_load(ALERT_recipient)){
+			ALERT_tries = 0;
+			ALERT_try();
+			return;
+		}
+	}
+	ALERT_state = ALERT_HOLD;
+	TIMER_start(&ALERT_timer, ALERT_HOLDOFF_MS, 0);
+}
+
+static void ALERT_send(void){
+	//a message of the counted alerts goes out to all recipients
+	ALERT_compose();
+	ALERT_recipient = 0xFF; //ALERT_next() starts at slot 0
+	ALERT_next();
+}
+
+static void ALERT_sent(unsigned char result){
+	//modem answered the message body, or the send failed
+#if TELEM
+	unsigned long ms = TICK_now() - ALERT_start;
+	TELEM_record(TELEM_SMS, ms > 0xFFFF ? 0xFFFF : ms);
+#endif
+	if(result == GSM_OK){
+		ALERT_next();
+	}
+	else if(++ALERT_tries > ALERT_RETRIES){
+		AUDIT_log(AUDIT_ALERT_LOST, ALERT_recipient);
+		ALERT_next();
+	}
+	else{
+		TIMER_start(&ALERT_timer, (unsigned int)ALERT_RETRY_MS << (ALERT_tries - 1), 0); //back off
+	}
+}
+
+static void ALERT_tick(unsigned char arg){
+	unsigned char kind;
+	if(ALERT_state == ALERT_SENDING){
+		ALERT_try(); //back-off is over
+	}
+	else if(ALERT_state == ALERT_GATHER){
+		if(ALERT_ready){
+			ALERT_send();
+		}
+		else{
+			ALERT_state = ALERT_WAIT; //ALERT_modem() sends it
+		}
+	}
+	else{
+		ALERT_state = ALERT_IDLE; //hold-off is over
+		for(kind = 0; kind < ALERT_KINDS; kind++){
+			if(ALERT_count[kind] != 0){
+				ALERT_state = ALERT_GATHER; //alerts of the hold-off go out now
+				ALERT_tick(0);
+				break;
+			}
+		}
+	}
+}
+
+void ALERT_raise(unsigned char kind){
+	if(ALERT_count[kind] < 0xFF){
+		ALERT_count[kind]++;
+	}
+	if(ALERT_state == ALERT_IDLE){
+		ALERT_state = ALERT_GATHER;
+		TIMER_start(&ALERT_timer, ALERT_GATHER_MS, 0);
+	}
+}
+
+void ALERT_modem(unsigned char ready){
+	//the modem finished its configuration (1) or is brought up again (0)
+	ALERT_ready = ready;
+	if(ready && ALERT_state == ALERT_WAIT){
+		ALERT_send();
+	}
+}
+
+unsigned char ALERT_command(const char* line, unsigned char len){
+	
+	//ALERT_command() handles a "#ALERT n ..." line of the service port,
+	//returns 1 if the line was one, malformed lines are ignored, a number is
+	//digits with an optional leading '+'
+	
+	unsigned char slot = 0, i = 7, n;
+	int addr;
+	if(len < 9 || memcmp(line, "#ALERT ", 7) != 0){
+		return 0;
+	}
+	while(i < len && line[i] >= '0' && line[i] <= '9' && slot < ALERT_RECIPIENTS){
+		slot = slot * 10 + line[i++] - '0';
+	}
+	if(i == 7 || i >= len || line[i++] != ' ' || slot >= ALERT_RECIPIENTS){
+		return 1;
+	}
+	addr = ALERT_addr(slot);
+	if(len - i == 3 && memcmp(line + i, "OFF", 3) == 0){
+		EEPROM_write(addr, ALERT_OFF);
+		return 1;
+	}
+	if(i == len || len - i > ALERT_RECORD - 1 || len - i == (line[i] == '+')){
+		return 1;
+	}
+	for(n = line[i] == '+'; i + n < len; n++){
+		if(line[i + n] < '0' || line[i + n] > '9'){
+			return 1;
+		}
+	}
+	EEPROM_write(addr, ALERT_OFF); //a torn record stays off
+	for(n = 0; n < ALERT_RECORD - 1; n++){
+		EEPROM_write(addr + 1 + n, i + n < len ? line[i + n] : 0);
+	}
+	EEPROM_write(addr, ALERT_ON);
+	return 1;
+}
@@ -0,0 +1,30 @@
+#ifndef ALERT_H
+#define ALERT_H
+
+//alert queue
+//ALERT_raise() only counts the alert, alerts raised within ALERT_GATHER_MS
+//of the first one go into one message, e.g. "Alert:\rSystem blocked after 3
+//wrong passwords x2", which is sent to every recipient in turn, a failed
+//send is tried again after ALERT_RETRY_MS, 2 * ALERT_RETRY_MS, ... up to
+//ALERT_RETRIES times, then the recipient is given up and AUDIT_ALERT_LOST is
+//logged, alerts raised while the message goes out or in the ALERT_HOLDOFF_MS
+//after it are counted into the next message, so the queue never holds more
+//than the message being sent and the counts of the next one, and a person
+//hammering the keypad causes at most one message per recipient and hold-off
+//nothing is sent before ALERT_modem(1), the modem is configured once when it
+//comes up, not per message
+//recipients, ALERT_RECIPIENTS records in EEPROM of a flag byte and up to 15
+//characters of the number, slot 0 is CONTACT_NUMBER until it is set
+//service port lines: "#ALERT n number" sets recipient n, "#ALERT n OFF"
+//removes it
+
+#define ALERT_LOCKOUT 0 //three wrong PINs
+#define ALERT_RESUMED 1 //lock booted in a lockout, the power was cut
+#define ALERT_KINDS 2
+
+void ALERT_init(void);
+void ALERT_raise(unsigned char kind);
+void ALERT_modem(unsigned char ready);
+unsigned char ALERT_command(const char* line, unsigned char len);
+
+#endif
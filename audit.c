@@ -0,0 +1,191 @@
+//included libraries
+#include "config.h"
+#include <string.h>
+#include "audit.h"
+#include "cred.h"
+#include "eeprom.h"
+#include "frame.h"
+#include "tick.h"
+#include "timer.h"
+
+#if AUDIT_BASE < CRED_BASE + (CRED_USERS - 1) * (PIN_LENGTH + 1)
+#error "audit log overlaps the credential records"
+#endif
+#if AUDIT_BASE + AUDIT_RECORDS * AUDIT_RECORD > 0x400
+#error "audit log does not fit the 1 kB EEPROM"
+#endif
+
+struct AUDIT_entry{
+	unsigned char event;
+	unsigned char user;
+	unsigned long time;
+};
+
+//RAM batch, filled by AUDIT_log() and drained by AUDIT_flush(), both run in
+//the main loop
+static struct AUDIT_entry AUDIT_batch[AUDIT_BATCH];
+static unsigned char AUDIT_head, AUDIT_tail;
+static unsigned char AUDIT_slot; //next slot to write
+static unsigned char AUDIT_lap; //lap bit of the records written in this lap
+static unsigned int AUDIT_lost; //events dropped with a full batch
+static struct TIMER AUDIT_timer;
+static AUDIT_log_fn AUDIT_handler; //gets every event, 0 if none
+
+static int AUDIT_addr(unsigned char slot){
+	return AUDIT_BASE + slot * AUDIT_RECORD;
+}
+
+void AUDIT_load(void){
+	
+	//AUDIT_load() finds the next slot at boot, the slots before it carry the
+	//lap bit of slot 0, the next slot is erased, torn or from the previous
+	//lap, if every slot has the lap bit of slot 0 the ring is full and the
+	//next lap starts at slot 0
+	
+	unsigned char first = EEPROM_read(AUDIT_addr(0)), b;
+	AUDIT_head = 0;
+	AUDIT_tail = 0;
+	AUDIT_lost = 0;
+	AUDIT_handler = 0;
+	TIMER_setup(&AUDIT_timer, AUDIT_flush, 0);
+	AUDIT_lap = first & 0x80;
+	for(AUDIT_slot = 0; AUDIT_slot < AUDIT_RECORDS; AUDIT_slot++){
+		b = EEPROM_read(AUDIT_addr(AUDIT_slot));
+		if((b & 0x0F) == AUDIT_EMPTY || (b & 0x80) != AUDIT_lap){
+			return;
+		}
+	}
+	AUDIT_slot = 0;
+	AUDIT_lap ^= 0x80;
+}
+
+void AUDIT_log(unsigned char event, unsigned char user){
+	unsigned char next = (AUDIT_head + 1) & (AUDIT_BATCH - 1);
+	if(AUDIT_handler){
+		AUDIT_handler(event, user); //also with a full batch
+	}
+	if(next == AUDIT_tail){
+		AUDIT_lost++; //EEPROM far behind, keep the older events
+		return;
+	}
+	AUDIT_batch[AUDIT_head].event = event;
+	AUDIT_batch[AUDIT_head].user = user;
+	AUDIT_batch[AUDIT_head].time = TICK_now();
+	AUDIT_head = next;
+	if(!AUDIT_timer.armed){
+		TIMER_start(&AUDIT_timer, AUDIT_FLUSH_MS, 0);
+	}
+}
+
+void AUDIT_on_log(AUDIT_log_fn handler){
+	AUDIT_handler = handler;
+}
+
+void AUDIT_flush(unsigned char arg){
+	
+	//AUDIT_flush() queues the batched records while the EEPROM write queue
+	//has room for a whole record and the erase of its event byte, the rest is
+	//tried again after AUDIT_FLUSH_MS
+	
+	struct AUDIT_entry* e;
+	int addr;
+	unsigned char i;
+	while(AUDIT_tail != AUDIT_head && EEPROM_pending() + AUDIT_RECORD + 1 < EEPROM_QUEUE){
+		e = &AUDIT_batch[AUDIT_tail];
+		addr = AUDIT_addr(AUDIT_slot);
+		EEPROM_write(addr, AUDIT_EMPTY | AUDIT_lap); //old record gone, slot 0 keeps the lap
+		EEPROM_write(addr + 1, e->user);
+		for(i = 0; i < 4; i++){
+			EEPROM_write(addr + 2 + i, e->time >> (8 * i));
+		}
+		EEPROM_write(addr, e->event | AUDIT_lap); //record is valid from here
+		if(++AUDIT_slot == AUDIT_RECORDS){
+			AUDIT_slot = 0;
+			AUDIT_lap ^= 0x80;
+		}
+		AUDIT_tail = (AUDIT_tail + 1) & (AUDIT_BATCH - 1);
+	}
+	if(AUDIT_tail != AUDIT_head){
+		TIMER_start(&AUDIT_timer, AUDIT_FLUSH_MS, 0);
+	}
+}
+
+unsigned char AUDIT_newest(unsigned char back, unsigned char* event, unsigned char* user,
+	unsigned long* time){
+	
+	//AUDIT_newest() reads the record back places before the newest one (0 is
+	//the newest), from the batch first and then from EEPROM, returns 0 if
+	//there are fewer records
+	
+	unsigned char batched = (AUDIT_head - AUDIT_tail) & (AUDIT_BATCH - 1), slot, b, i;
+	int addr;
+	struct AUDIT_entry* e;
+	if(back < batched){
+		e = &AUDIT_batch[(AUDIT_head - 1 - back) & (AUDIT_BATCH - 1)];
+		*event = e->event;
+		*user = e->user;
+		*time = e->time;
+		return 1;
+	}
+	back -= batched;
+	if(back >= AUDIT_RECORDS){
+		return 0;
+	}
+	slot = (AUDIT_slot + AUDIT_RECORDS - 1 - back) % AUDIT_RECORDS;
+	addr = AUDIT_addr(slot);
+	b = EEPROM_read(addr);
+	if((b & 0x0F) == AUDIT_EMPTY){
+		return 0;
+	}
+	*event = b & 0x0F;
+	*user = EEPROM_read(addr + 1);
+	*time = 0;
+	for(i = 4; i > 0; i--){
+		*time = (*time << 8) | (unsigned char)EEPROM_read(addr + 1 + i);
+	}
+	return 1;
+}
+
+void AUDIT_send(void){
+	
+	//AUDIT_send() streams the log as one frame, the records in EEPROM from
+	//the oldest slot and then the batch which is not written yet, the slots
+	//are counted first because the length goes in front of the payload
+	
+	unsigned char slot, n, i, b;
+	unsigned int count = 0;
+	int addr;
+	for(slot = 0; slot < AUDIT_RECORDS; slot++){
+		if((EEPROM_read(AUDIT_addr(slot)) & 0x0F) != AUDIT_EMPTY){
+			count++;
+		}
+	}
+	count += (AUDIT_head - AUDIT_tail) & (AUDIT_BATCH - 1);
+	FRAME_begin(FRAME_AUDIT, 8 + count * AUDIT_RECORD);
+	FRAME_long(TICK_now());
+	FRAME_word(count);
+	FRAME_word(AUDIT_lost);
+	for(n = 0, slot = AUDIT_slot; n < AUDIT_RECORDS; n++){
+		addr = AUDIT_addr(slot);
+		b = EEPROM_read(addr);
+		if((b & 0x0F) != AUDIT_EMPTY){
+			FRAME_byte(b & 0x0F);
+			for(i = 1; i < AUDIT_RECORD; i++){
+				FRAME_byte(EEPROM_read(addr + i));
+			}
+		}
+		if(++slot == AUDIT_RECORDS){
+			slot = 0;
+		}
+	}
+	for(n = AUDIT_tail; n != AUDIT_head; n = (n + 1) & (AUDIT_BATCH - 1)){
+		FRAME_byte(AUDIT_batch[n].event);
+		FRAME_byte(AUDIT_batch[n].user);
+		FRAME_long(AUDIT_batch[n].time);
+	}
+	FRAME_end();
+}
+
+unsigned char AUDIT_requested(const char* line, unsigned char len){
+	return len == 6 && memcmp(line, "#AUDIT", 6) == 0;
+}
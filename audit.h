@@ -0,0 +1,50 @@
+#ifndef AUDIT_H
+#define AUDIT_H
+
+//access audit log
+//events are appended as packed records to a ring of AUDIT_RECORDS slots in
+//EEPROM from AUDIT_BASE, the oldest record is overwritten when the ring is
+//full, AUDIT_log() only stores the event in a RAM batch of AUDIT_BATCH
+//records, a timer task moves whole records into the EEPROM write queue while
+//the queue has room for them, so logging never waits for the EEPROM and
+//never delays a key, events of a full batch are counted as lost
+//record, 6 bytes: event (bits 0 - 3) and lap bit (bit 7), user slot
+//(CRED_NONE if there is none), tick time in ms since boot (4 bytes), the
+//event byte is erased first and written last, so a record torn by a power
+//cut reads as an erased slot, also over a record of the previous lap
+//the line "#AUDIT" on the service port makes the lock send the whole log as
+//one binary frame (frame.h) FRAME_AUDIT, payload: uptime ms (4), record
+//count (2), lost events (2), then the records from the oldest, event byte
+//without the lap bit
+//AUDIT_on_log() passes every event to a handler as well (the multi-door bus,
+//bus.h), AUDIT_load() removes the handler
+
+//events
+#define AUDIT_BOOT 0 //power on
+#define AUDIT_OPEN 1 //right PIN opened the door
+#define AUDIT_CLOSE 2 //right PIN closed the door
+#define AUDIT_WRONG 3 //wrong PIN
+#define AUDIT_LOCKOUT 4 //third wrong PIN, system blocked
+#define AUDIT_UNBLOCK 5 //lockout is over
+#define AUDIT_PIN_CHANGE 6 //user set a new PIN at the door
+#define AUDIT_USER_SET 7 //PIN set on the service port
+#define AUDIT_USER_OFF 8 //user disabled on the service port
+#define AUDIT_USER_ON 9 //user enabled on the service port
+#define AUDIT_SMS_DENIED 10 //SMS from the contact number with a wrong PIN
+#define AUDIT_ALERT_LOST 11 //alert SMS given up, user is the recipient slot
+#define AUDIT_EMPTY 0x0F //erased slot
+
+#define AUDIT_RECORD 6
+
+typedef void (*AUDIT_log_fn)(unsigned char event, unsigned char user);
+
+void AUDIT_load(void);
+void AUDIT_log(unsigned char event, unsigned char user);
+void AUDIT_on_log(AUDIT_log_fn handler);
+void AUDIT_flush(unsigned char arg);
+unsigned char AUDIT_newest(unsigned char back, unsigned char* event, unsigned char* user,
+	unsigned long* time);
+void AUDIT_send(void);
+unsigned char AUDIT_requested(const char* line, unsigned char len);
+
+#endif
@@ -0,0 +1,113 @@
+//included libraries
+#include "config.h"
+#include "hal.h"
+#include "bench.h"
+#include "uart.h"
+
+#if BENCH
+
+static struct BENCH_stat BENCH_stats[BENCH_PROBES];
+static unsigned long BENCH_started[BENCH_PROBES]; //cycle stamp of the start
+static unsigned char BENCH_armed; //started probes, one bit each
+
+//probe names of the report
+static const char BENCH_names[BENCH_PROBES][10] HAL_FLASH = {
+	"key", "verify", "eeprom", "sms", "key_lcd", "key_relay"
+};
+
+void BENCH_init(void){
+	unsigned char i, b;
+	for(i = 0; i < BENCH_PROBES; i++){
+		BENCH_stats[i].count = 0;
+		BENCH_stats[i].min = 0xFFFFFFFFUL;
+		BENCH_stats[i].max = 0;
+		BENCH_stats[i].total = 0;
+		for(b = 0; b < BENCH_BUCKETS; b++){
+			BENCH_stats[i].hist[b] = 0;
+		}
+	}
+	BENCH_armed = 0;
+}
+
+void BENCH_start(unsigned char probe){
+	//a probe which is already started keeps its first stamp, so a key release
+	//does not restart the latency of the press
+	HAL_ATOMIC{
+		if((BENCH_armed & (1 << probe)) == 0){
+			BENCH_started[probe] = HAL_cycles();
+			BENCH_armed |= 1 << probe;
+		}
+	}
+}
+
+void BENCH_stop(unsigned char probe){
+	unsigned long cycles, c;
+	unsigned char b = 0;
+	struct BENCH_stat* stat = &BENCH_stats[probe];
+	HAL_ATOMIC{
+		if(BENCH_armed & (1 << probe)){
+			BENCH_armed &= ~(1 << probe);
+			cycles = HAL_cycles() - BENCH_started[probe];
+			for(c = cycles >> BENCH_SHIFT; c > 1 && b < BENCH_BUCKETS - 1; c >>= 1){
+				b++; //bucket is the base 2 logarithm
+			}
+			stat->count++;
+			stat->total += cycles;
+			if(cycles < stat->min){
+				stat->min = cycles;
+			}
+			if(cycles > stat->max){
+				stat->max = cycles;
+			}
+			if(stat->hist[b] != 0xFFFF){
+				stat->hist[b]++; //saturating
+			}
+		}
+	}
+}
+
+void BENCH_cancel(unsigned char probe){
+	HAL_ATOMIC{
+		BENCH_armed &= ~(1 << probe);
+	}
+}
+
+void BENCH_get(unsigned char probe, struct BENCH_stat* stat){
+	HAL_ATOMIC{
+		*stat = BENCH_stats[probe];
+	}
+}
+
+void BENCH_report(void){
+	
+	//BENCH_report() sends one line per probe on the service port, fields are
+	//key=value pairs, times in cycles, hist lists the buckets from 2^BENCH_SHIFT
+	//cycles, e.g.
+	//#BENCH probe=verify n=12 min=96 mean=104 max=120 hist=0,0,0,0,12,0,...
+	
+	struct BENCH_stat stat;
+	unsigned char i, b;
+	for(i = 0; i < BENCH_PROBES; i++){
+		BENCH_get(i, &stat);
+		UART_send_string_P(HAL_PSTR("#BENCH probe="));
+		UART_send_string_P(BENCH_names[i]);
+		UART_send_string_P(HAL_PSTR(" n="));
+		UART_send_number(stat.count);
+		UART_send_string_P(HAL_PSTR(" min="));
+		UART_send_number(stat.count ? stat.min : 0);
+		UART_send_string_P(HAL_PSTR(" mean="));
+		UART_send_number(stat.count ? stat.total / stat.count : 0);
+		UART_send_string_P(HAL_PSTR(" max="));
+		UART_send_number(stat.max);
+		UART_send_string_P(HAL_PSTR(" hist="));
+		for(b = 0; b < BENCH_BUCKETS; b++){
+			if(b > 0){
+				UART_send_char(',');
+			}
+			UART_send_number(stat.hist[b]);
+		}
+		UART_send_string_P(HAL_PSTR("\r\n"));
+	}
+}
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+//benchmark probes
+//a probe measures the time from BENCH_start() to BENCH_stop() in CPU cycles
+//(HAL_cycles(), on the ATmega Timer1 with 8 cycle resolution) and keeps the
+//count, minimum, maximum, sum and a histogram with power of 2 buckets, bucket
+//i holds times from 2^(i + BENCH_SHIFT) cycles, the last one everything above
+//code path probes are started and stopped around the path, the latency probes
+//are started by the tick interrupt on a debounced key edge and stopped when
+//the LCD shows the new frame or the relay switched, with BENCH set to 0 in
+//config.h the probes compile to nothing
+
+#define BENCH_KEY 0 //key handler, get_key(), run_key_function(), display()
+#define BENCH_VERIFY 1 //verify_password()
+#define BENCH_EEPROM 2 //EEPROM_write()
+#define BENCH_SMS 3 //send_sms(), the alert is queued
+#define BENCH_KEY_LCD 4 //key edge to the LCD showing the new frame
+#define BENCH_KEY_RELAY 5 //key edge to the relay switched
+#define BENCH_PROBES 6
+
+#define BENCH_BUCKETS 16
+#define BENCH_SHIFT 3
+
+struct BENCH_stat{
+	unsigned long count;
+	unsigned long min;
+	unsigned long max;
+	unsigned long total;
+	unsigned int hist[BENCH_BUCKETS];
+};
+
+#if BENCH
+void BENCH_init(void);
+void BENCH_start(unsigned char probe);
+void BENCH_stop(unsigned char probe);
+void BENCH_cancel(unsigned char probe);
+void BENCH_get(unsigned char probe, struct BENCH_stat* stat);
+void BENCH_report(void);
+#else
+#define BENCH_init()
+#define BENCH_start(probe)
+#define BENCH_stop(probe)
+#define BENCH_cancel(probe)
+#define BENCH_report()
+#endif
+
+#endif
@@ -0,0 +1,192 @@
+//included libraries
+#include "config.h"
+#include "hal.h"
+#include "bus.h"
+#include "frame.h"
+#include "uart.h"
+#include "timer.h"
+#include "tick.h"
+
+#if BUS_ADDRESS < 0 || BUS_ADDRESS > 254
+#error "BUS_ADDRESS is 0 (no bus) or a door address from 1 to 254"
+#endif
+#if BUS_ADDRESS && SLEEP_MODE == 2
+#error "a door on the bus can not power down, the byte which wakes it is lost"
+#endif
+#if 5 + PIN_LENGTH > BUS_PAYLOAD
+#error "BUS_PIN command does not fit the poll"
+#endif
+
+static struct BUS_door BUS_self; //door of this firmware
+static struct TIMER BUS_timer; //waits for the reply to leave the UART
+
+void BUS_door_init(struct BUS_door* door, unsigned char address, BUS_command_fn execute){
+	door->address = address;
+	door->flags = BUS_BOOT;
+	door->seq = 0;
+	door->head = 0;
+	door->count = 0;
+	door->sent = 0;
+	door->command = 0;
+	door->execute = execute;
+	door->rx_len = 0;
+	door->tx_len = 0;
+}
+
+void BUS_door_event(struct BUS_door* door, unsigned char event, unsigned char user, unsigned long time){
+	struct BUS_event* e;
+	if(door->count == BUS_EVENTS){
+		door->head = (door->head + 1) & (BUS_EVENTS - 1); //drop the oldest
+		door->count--;
+		door->sent = 0;
+		door->flags |= BUS_LOST;
+	}
+	if(++door->seq == 0){
+		door->seq = 1; //0 acknowledges nothing
+	}
+	e = &door->events[(door->head + door->count) & (BUS_EVENTS - 1)];
+	e->seq = door->seq;
+	e->event = event;
+	e->user = user;
+	e->time = time;
+	door->count++;
+}
+
+unsigned char BUS_frame(unsigned char* frame, unsigned char type, const unsigned char* payload,
+	unsigned char len){
+	
+	//BUS_frame() builds a frame (frame.h) in a buffer of len + 5 bytes and
+	//returns its length
+	
+	unsigned char crc, i;
+	frame[0] = FRAME_SYNC;
+	frame[1] = type;
+	frame[2] = len;
+	frame[3] = 0;
+	for(i = 0; i < len; i++){
+		frame[4 + i] = payload[i];
+	}
+	for(crc = 0, i = 1; i < len + 4; i++){
+		crc = FRAME_crc8(crc, frame[i]);
+	}
+	frame[len + 4] = crc;
+	return len + 5;
+}
+
+static void BUS_reply(struct BUS_door* door){
+	//answer to a poll, the oldest event goes with it
+	unsigned char payload[10], len = 3;
+	struct BUS_event* e = &door->events[door->head];
+	payload[0] = door->address;
+	payload[1] = door->flags | (door->count > 1 ? BUS_MORE : 0);
+	payload[2] = door->command;
+	if(door->count != 0){
+		payload[3] = e->seq;
+		payload[4] = e->event;
+		payload[5] = e->user;
+		payload[6] = e->time;
+		payload[7] = e->time >> 8;
+		payload[8] = e->time >> 16;
+		payload[9] = e->time >> 24;
+		len = 10;
+		door->sent = 1;
+	}
+	door->tx_len = BUS_frame(door->tx, FRAME_REPLY, payload, len);
+}
+
+static void BUS_polled(struct BUS_door* door, const unsigned char* p, unsigned char len){
+	
+	//BUS_polled() takes the acknowledgement and the command of a poll for
+	//this door, an acknowledgement counts only for an event which was sent
+	
+	if(door->flags & BUS_BOOT){
+		if(p[1] == 0){
+			door->flags &= ~BUS_BOOT; //controller forgot the previous boot
+		}
+	}
+	else if(door->count != 0 && door->sent && p[1] == door->events[door->head].seq){
+		door->head = (door->head + 1) & (BUS_EVENTS - 1);
+		door->count--;
+		door->sent = 0;
+		door->flags &= ~BUS_LOST;
+	}
+	if(len >= 4 && p[2] != door->command){
+		door->command = p[2];
+		if(door->execute){
+			door->execute(p[3], p + 4, len - 4);
+		}
+	}
+	BUS_reply(door);
+}
+
+unsigned char BUS_door_rx(struct BUS_door* door, unsigned char c){
+	
+	//BUS_door_rx() takes the next byte of the line, returns 1 when a poll for
+	//this door was received, its reply is in tx, a frame with a wrong CRC or
+	//length is dropped and the next FRAME_SYNC starts over, the line is quiet
+	//between the frames, so the receiver finds the next one
+	
+	unsigned char i, crc, len;
+	if(door->rx_len == 0){
+		if(c == FRAME_SYNC){
+			door->rx_len = 1;
+		}
+		return 0;
+	}
+	door->rx[door->rx_len - 1] = c;
+	door->rx_len++;
+	if(door->rx_len == 4 && (door->rx[1] > BUS_PAYLOAD || door->rx[2] != 0)){
+		door->rx_len = 0; //not a bus frame
+		return 0;
+	}
+	if(door->rx_len < 4 || door->rx_len < door->rx[1] + 5){
+		return 0;
+	}
+	door->rx_len = 0;
+	len = door->rx[1];
+	for(crc = 0, i = 0; i < len + 3; i++){
+		crc = FRAME_crc8(crc, door->rx[i]);
+	}
+	if(crc != door->rx[len + 3] || door->rx[0] != FRAME_POLL || len < 2 || door->rx[3] != door->address){
+		return 0; //broken, a reply of another door or a poll for another door
+	}
+	BUS_polled(door, door->rx + 3, len);
+	return 1;
+}
+
+static void BUS_release(unsigned char arg){
+	//the reply left the UART, the line is free for the controller
+	if(UART_tx_idle()){
+		HAL_bus_drive(0);
+		TIMER_cancel(&BUS_timer);
+	}
+}
+
+void BUS_init(BUS_command_fn execute){
+	BUS_door_init(&BUS_self, BUS_ADDRESS, execute);
+	TIMER_setup(&BUS_timer, BUS_release, 0);
+	HAL_bus_drive(0);
+}
+
+void BUS_event(unsigned char event, unsigned char user){
+	//audit event, reported to the controller
+	BUS_door_event(&BUS_self, event, user, TICK_now());
+}
+
+void BUS_poll(void){
+	
+	//BUS_poll() takes the received bytes out of the UART receive ring, a
+	//reply is enqueued at once with the driver on, the timer turns it off
+	//after the last byte
+	
+	unsigned char c, i;
+	while(UART_receive(&c)){
+		if(BUS_door_rx(&BUS_self, c)){
+			HAL_bus_drive(1);
+			for(i = 0; i < BUS_self.tx_len; i++){
+				UART_send_char(BUS_self.tx[i]);
+			}
+			TIMER_start(&BUS_timer, 1, 1);
+		}
+	}
+}
@@ -0,0 +1,77 @@
+#ifndef BUS_H
+#define BUS_H
+
+//multi-door bus
+//with BUS_ADDRESS 1 to 254 the UART is an RS-485 line shared by the doors and
+//a controller (address 0) which owns the GSM modem, the controller polls the
+//doors in turn and a door only speaks to answer a poll for its address, so
+//the line needs no arbitration, the driver of the transceiver (BUS_DE) is on
+//only while the answer is sent
+//frames are the ones of the service port (frame.h), every door parses every
+//frame on the line and answers only FRAME_POLL frames for its address
+//poll, FRAME_POLL: address, sequence of the event acknowledged (0 none),
+//optionally a command: command sequence, command, arguments
+//reply, FRAME_REPLY: address, flags, sequence of the last command executed,
+//optionally the oldest event not acknowledged: sequence, event (audit.h),
+//user, tick time in ms since boot (4 bytes)
+//an event is sent in every reply until a poll acknowledges its sequence, a
+//command is executed once, a poll which repeats the sequence of the last
+//command only gets the reply, so a frame lost in either direction costs a
+//poll and loses nothing, BUS_EVENTS events are queued, the oldest one is
+//dropped on overflow and the replies carry BUS_LOST until the next event
+//is acknowledged
+//after a boot the replies carry BUS_BOOT and acknowledgements are ignored
+//until a poll acknowledges nothing, so a stale acknowledgement of the
+//controller never removes an event of the new boot
+
+//reply flags
+#define BUS_BOOT 0x01 //door booted, acknowledgements are ignored
+#define BUS_LOST 0x02 //events were dropped
+#define BUS_MORE 0x04 //more events are queued, poll again
+
+//commands
+#define BUS_UNBLOCK 1 //end the lockout
+#define BUS_PIN 2 //user, PIN_LENGTH digits (0 - 9)
+
+#define BUS_PAYLOAD 24 //longest payload, poll with a PIN or reply with an event
+#define BUS_FRAME (BUS_PAYLOAD + 5)
+
+typedef void (*BUS_command_fn)(unsigned char command, const unsigned char* args, unsigned char len);
+
+struct BUS_event{
+	unsigned char seq;
+	unsigned char event;
+	unsigned char user;
+	unsigned long time;
+};
+
+//protocol state of one door, the firmware has one, the host simulator one per
+//virtual door
+struct BUS_door{
+	unsigned char address;
+	unsigned char flags; //BUS_BOOT and BUS_LOST
+	unsigned char seq; //sequence of the newest event
+	unsigned char head, count; //event ring
+	unsigned char sent; //oldest event went out in a reply
+	unsigned char command; //sequence of the last command executed
+	BUS_command_fn execute;
+	struct BUS_event events[BUS_EVENTS];
+	unsigned char rx[BUS_FRAME]; //frame being received, from the type
+	unsigned char rx_len; //bytes of it, 0 while looking for FRAME_SYNC
+	unsigned char tx[BUS_FRAME]; //reply
+	unsigned char tx_len;
+};
+
+//protocol engine, no I/O
+void BUS_door_init(struct BUS_door* door, unsigned char address, BUS_command_fn execute);
+void BUS_door_event(struct BUS_door* door, unsigned char event, unsigned char user, unsigned long time);
+unsigned char BUS_door_rx(struct BUS_door* door, unsigned char c);
+unsigned char BUS_frame(unsigned char* frame, unsigned char type, const unsigned char* payload,
+	unsigned char len);
+
+//door of this firmware on the UART
+void BUS_init(BUS_command_fn execute);
+void BUS_event(unsigned char event, unsigned char user);
+void BUS_poll(void);
+
+#endif
@@ -0,0 +1,192 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+//preprocessor directives, which define CPU frequnecy and PORT division
+//config.h is included by every module before any AVR-libc header, so that
+//util/delay.h sees F_CPU
+//PORTA will be responsible for LCD data control
+//PORTB is connected to 4x4 keypad matrix and responsible for scanning that matrix
+//PORTC is declared as output PORT to control relay and buzzer
+//PORTD will be responsible for sending commands to LCD
+
+#define F_CPU 8000000UL
+#define LCD_DATA PORTA
+#define DATA_DDR DDRA
+#define MATRIX_DATA PORTB
+#define MATRIX_DDR DDRB
+#define OUT_PORT PORTC
+#define OUT_DDR DDRC
+#define LCD_CONTROL PORTD
+#define CONTROL_DDR DDRD
+
+//preprocessor directive which defines UART speed 
+#define BAUD_PRESCALE (((F_CPU / (UART_BAUDRATE * 16UL))) - 1)
+
+//UART transmit ring size, has to be a power of 2 not bigger than 128, it holds
+//a whole alert SMS, longer strings are enqueued as the ring drains
+#define UART_TX_QUEUE 128
+
+//UART receive ring size, power of 2 up to 256, at 9600 baud a byte arrives
+//every ~1 ms, so the main loop has 256 ms to take the bytes out before an
+//overrun, enough for an EEPROM_commit of a full write queue during a burst
+//of SMS listings
+#define UART_RX_QUEUE 256
+
+//GSM AT command engine, number of queued commands (power of 2), length of
+//the longest modem answer line kept for matching and delay before a command
+//which got ERROR is sent again
+#define GSM_QUEUE 16
+#define GSM_LINE 96
+#define GSM_RETRY_MS 500
+
+//SMS command channel (sms.h), alerts go to and commands are taken from
+//CONTACT_NUMBER, SMS_TEXT is the longest answer the lock sends
+#define CONTACT_NUMBER "0998742925"
+#define SMS_TEXT 120
+
+//alert queue (alert.h), alerts raised within ALERT_GATHER_MS go into one
+//message, after a message went out to every recipient new alerts are held
+//back ALERT_HOLDOFF_MS and sent together, a failed send is tried again
+//ALERT_RETRIES times after ALERT_RETRY_MS, doubled every time, ALERT_TEXT is
+//the longest message, the ALERT_RECIPIENTS numbers are records of
+//ALERT_RECORD bytes from ALERT_BASE after the audit log
+#define ALERT_GATHER_MS 500
+#define ALERT_HOLDOFF_MS 60000
+#define ALERT_RETRIES 3
+#define ALERT_RETRY_MS 5000
+#define ALERT_TEXT 100
+#define ALERT_BASE 0x3C0
+#define ALERT_RECIPIENTS 4
+#define ALERT_RECORD 16
+
+//multi-door bus (bus.h), BUS_ADDRESS 0 is a standalone lock with its own
+//GSM module, 1 to 254 is a door on an RS-485 line at BUS_BAUDRATE, the UART
+//talks to the transceiver and PD3 (BUS_DE) enables its driver, the service
+//port and the GSM module are not used, the controller sends the alerts,
+//BUS_EVENTS is the event queue size and has to be a power of 2
+#ifndef BUS_ADDRESS
+#define BUS_ADDRESS 0
+#endif
+#define BUS_BAUDRATE 38400
+#define BUS_DE 3
+#define BUS_EVENTS 8
+
+//modem bring-up, "AT" is sent every GSM_PROBE_MS until the module answers OK,
+//then the gsm_initialization() sequence is queued
+#define GSM_PROBE_MS 500
+
+//pins PD4, PD5 and PD6 are responsible for shifting LCD screen between data
+//and control manipulation and for enabling communication 
+#define RS 4
+#define RW 5
+#define EN 6
+
+//PC5, PC6 and PC7 pins are connected to LEDs which indicates system state
+//blocked state system LED -> PC5
+//wait state system LED -> PD6
+//ready state system LED -> PD7
+#define BLOCKED 5
+#define WAIT 6
+#define READY 7
+
+//LCD timing, with LCD_BUSY_FLAG set the driver reads the HD44780 busy flag
+//over RW (PD5) and continues as soon as the controller is ready, with
+//LCD_BUSY_FLAG cleared the fixed worst-case delays are used instead
+//LCD_FLUSH_BURST limits the number of transfers made in one timer tick
+#define LCD_BUSY_FLAG 1
+#define LCD_FLUSH_BURST 4
+
+//keypad scanner, one column is scanned per tick so every key is sampled each
+//4 ms, a key has to read the same KEYPAD_DEBOUNCE samples in a row (20 ms)
+//before a press or release is reported, KEYPAD_QUEUE is the event ring size
+//and has to be a power of 2
+#define KEYPAD_DEBOUNCE 5
+#define KEYPAD_QUEUE 16
+
+//PIN length and keypad layout (keymap.h), the layout lists the meaning of the
+//keys in key code order, rows 1 2 3 clear / 4 5 6 change / 7 8 9 set /
+//reset 0 show open
+#ifndef PIN_LENGTH
+#define PIN_LENGTH 4
+#endif
+#ifndef KEYMAP_LAYOUT
+#define KEYMAP_LAYOUT {1, 2, 3, KEY_CLEAR, 4, 5, 6, KEY_CHANGE, 7, 8, 9, KEY_SET, \
+	KEY_RESET, 0, KEY_SHOW, KEY_OPEN}
+#endif
+
+//lockout, the system stays blocked for BLOCK_SECONDS after 3 wrong attempts
+#ifndef BLOCK_SECONDS
+#define BLOCK_SECONDS 10
+#endif
+
+//EEPROM layout, PIN_LENGTH master PIN digits from address 0, legacy block flag at 10,
+//lock state journal of JOURNAL_SLOTS records of 8 bytes from JOURNAL_BASE
+//while blocked, the elapsed time is written every JOURNAL_CHECKPOINT seconds
+#define EEPROM_PASSWORD 0
+#define EEPROM_LEGACY_BLOCK 10
+#define JOURNAL_BASE 0x040
+#define JOURNAL_SLOTS 32
+#define JOURNAL_CHECKPOINT 60
+
+//credential store (cred.h), CRED_USERS PINs, user 0 is the master PIN at
+//EEPROM_PASSWORD, the records of the other users (PIN_LENGTH + 1 bytes) start
+//at CRED_BASE after the journal
+#define CRED_USERS 32
+#define CRED_BASE 0x140
+
+//audit log (audit.h), AUDIT_RECORDS records of 6 bytes from AUDIT_BASE after
+//the credential records, events are batched in RAM (AUDIT_BATCH, power of 2)
+//and queued for the EEPROM every AUDIT_FLUSH_MS
+#define AUDIT_BASE 0x2A0
+#define AUDIT_RECORDS 48
+#define AUDIT_BATCH 8
+#define AUDIT_FLUSH_MS 50
+
+//EEPROM write queue size, power of 2, holds a journal record and a password
+#define EEPROM_QUEUE 32
+
+//scheduler, size of the task queue (power of 2)
+#define SCHED_QUEUE 16
+
+//benchmark probes (bench.h), 1 compiles them in, the report is sent on the
+//service port every BENCH_REPORT_MS
+#ifndef BENCH
+#define BENCH 0
+#endif
+#define BENCH_REPORT_MS 60000
+
+//telemetry counters (telem.h), 0 compiles the hooks out
+#ifndef TELEM
+#define TELEM 1
+#endif
+
+//input trace for the host replay (trace.h), 1 compiles the recorder in,
+//TRACE_RING bytes of RAM hold the records until the next "#TRACE" dump and
+//have to be a power of 2
+#ifndef TRACE
+#define TRACE 0
+#endif
+#ifndef TRACE_RING
+#define TRACE_RING 256
+#endif
+
+//low power (sleep.h), 0 keeps the main loop spinning, 1 sleeps in idle mode
+//whenever no signal or task is pending, 2 also enters power-down while the
+//keypad, LCD, UART and EEPROM are idle and no software timer is armed, 2
+//needs the keypad columns and RXD (PD0) diode-ORed onto INT0 (PD2), after a
+//wake-up from power-down and after every received byte the lock stays awake
+//for SLEEP_AWAKE_MS, so the key which woke it is scanned and debounced and a
+//line from the modem is received whole
+#ifndef SLEEP_MODE
+#define SLEEP_MODE 1
+#endif
+#define SLEEP_AWAKE_MS 50
+
+//system tick, Timer1 in CTC mode with clk/8 prescale counts microseconds,
+//OCR1A = 999 gives 8 MHz / 8 / 1000 = 1 kHz, one compare match interrupt
+//every millisecond, TIMER_WHEEL is the number of timer wheel slots and has to
+//be a power of 2
+#define TICK_OCR1A 999
+#define TIMER_WHEEL 64
+
+#endif
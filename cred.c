@@ -0,0 +1,195 @@
+//included libraries
+#include "config.h"
+#include <string.h>
+#include "cred.h"
+#include "eeprom.h"
+#include "audit.h"
+
+//staff record, flag byte then PIN_LENGTH digits, CRED_ON and CRED_OFF are far
+//from the erased value 0xFF and from each other
+#define CRED_RECORD (PIN_LENGTH + 1)
+#define CRED_ON 0xA5
+#define CRED_OFF 0x5A
+
+#if CRED_USERS < 1 || CRED_USERS > 32
+#error "CRED_USERS has to fit the 32 bit user masks"
+#endif
+#if CRED_BASE + (CRED_USERS - 1) * CRED_RECORD > 0x400
+#error "credential records do not fit the 1 kB EEPROM"
+#endif
+
+typedef unsigned long CRED_mask; //one bit per user
+
+static CRED_mask CRED_index[PIN_LENGTH][10]; //users with this digit here
+static CRED_mask CRED_enabled; //users allowed to open
+static CRED_mask CRED_known; //users with a PIN (enabled or not)
+static CRED_mask CRED_candidates[PIN_LENGTH + 1]; //after 0, 1, ... digits
+
+static int CRED_addr(unsigned char user){
+	//EEPROM address of the first PIN digit of a user
+	if(user == 0){
+		return EEPROM_PASSWORD;
+	}
+	return CRED_BASE + (user - 1) * CRED_RECORD + 1;
+}
+
+static void CRED_index_user(unsigned char user){
+	
+	//CRED_index_user() puts the digits of one user from EEPROM into the index,
+	//a digit which is not 0 - 9 (erased cell) is in no mask, so that PIN never
+	//matches
+	
+	CRED_mask bit = (CRED_mask)1 << user;
+	unsigned char i, d;
+	int addr = CRED_addr(user);
+	for(i = 0; i < PIN_LENGTH; i++){
+		for(d = 0; d < 10; d++){
+			CRED_index[i][d] &= ~bit;
+		}
+		d = EEPROM_read(addr + i);
+		if(d < 10){
+			CRED_index[i][d] |= bit;
+		}
+	}
+}
+
+void CRED_load(void){
+	
+	//CRED_load() builds the RAM index from EEPROM at boot, every user is read
+	//once, the master PIN is always enabled
+	
+	unsigned char user, flags;
+	memset(CRED_index, 0, sizeof(CRED_index));
+	CRED_enabled = 1;
+	CRED_known = 1;
+	for(user = 0; user < CRED_USERS; user++){
+		if(user != 0){
+			flags = EEPROM_read(CRED_addr(user) - 1);
+			if(flags != CRED_ON && flags != CRED_OFF){
+				continue; //empty record
+			}
+			CRED_known |= (CRED_mask)1 << user;
+			if(flags == CRED_ON){
+				CRED_enabled |= (CRED_mask)1 << user;
+			}
+		}
+		CRED_index_user(user);
+	}
+	CRED_candidates[0] = CRED_enabled;
+}
+
+void CRED_digit(unsigned char position, unsigned char digit){
+	//digit entered at position, the candidates before it stay, so a clear key
+	//only has to step back
+	CRED_candidates[position + 1] = CRED_candidates[position] & CRED_index[position][digit];
+}
+
+static unsigned char CRED_lowest(CRED_mask candidates){
+	
+	//CRED_lowest() returns the lowest user in candidates or CRED_NONE, the
+	//loop runs over all users without an early exit or a branch on the
+	//candidates, so if two users share a PIN the lowest number wins
+	
+	unsigned char user, found = CRED_NONE, take;
+	for(user = CRED_USERS; user-- > 0;){
+		take = -(unsigned char)((candidates >> user) & 1); //0xFF if a candidate
+		found = (found & ~take) | (user & take);
+	}
+	return found;
+}
+
+unsigned char CRED_match(unsigned char length){
+	//user whose PIN was entered with length digits, or CRED_NONE
+	CRED_mask candidates = CRED_candidates[PIN_LENGTH];
+	candidates &= -(CRED_mask)(length == PIN_LENGTH);
+	return CRED_lowest(candidates);
+}
+
+unsigned char CRED_find(const char* digits){
+	
+	//CRED_find() returns the enabled user of a whole PIN (digit values) or
+	//CRED_NONE, it does not touch the entry at the keypad, every position is
+	//looked up whatever the digits, a value above 9 matches nobody
+	
+	CRED_mask candidates = CRED_enabled;
+	unsigned char i, d;
+	for(i = 0; i < PIN_LENGTH; i++){
+		d = digits[i];
+		candidates &= CRED_index[i][d < 10 ? d : 0] & -(CRED_mask)(d < 10);
+	}
+	return CRED_lowest(candidates);
+}
+
+void CRED_set(unsigned char user, const char* digits){
+	
+	//CRED_set() stores a new PIN of PIN_LENGTH digits, the EEPROM bytes are
+	//queued, the index is updated at once, a staff user gets enabled
+	
+	unsigned char i;
+	int addr = CRED_addr(user);
+	if(user >= CRED_USERS){
+		return;
+	}
+	for(i = 0; i < PIN_LENGTH; i++){
+		EEPROM_write(addr + i, digits[i]);
+	}
+	if(user != 0){
+		EEPROM_write(addr - 1, CRED_ON);
+		CRED_known |= (CRED_mask)1 << user;
+		CRED_enabled |= (CRED_mask)1 << user;
+		CRED_candidates[0] = CRED_enabled;
+	}
+	CRED_index_user(user);
+}
+
+void CRED_enable(unsigned char user, unsigned char on){
+	//the master PIN can not be disabled, a user without a PIN can not be enabled
+	CRED_mask bit = (CRED_mask)1 << user;
+	if(user == 0 || user >= CRED_USERS || !(CRED_known & bit)){
+		return;
+	}
+	EEPROM_write(CRED_addr(user) - 1, on ? CRED_ON : CRED_OFF);
+	if(on){
+		CRED_enabled |= bit;
+	}
+	else{
+		CRED_enabled &= ~bit;
+	}
+	CRED_candidates[0] = CRED_enabled;
+}
+
+unsigned char CRED_command(const char* line, unsigned char len){
+	
+	//CRED_command() handles a "#USER n ..." line of the service port, returns
+	//1 if the line was one, malformed lines are ignored
+	
+	char digits[PIN_LENGTH];
+	unsigned char user = 0, i = 6, n = 0;
+	if(len < 8 || memcmp(line, "#USER ", 6) != 0){
+		return 0;
+	}
+	while(i < len && line[i] >= '0' && line[i] <= '9' && user < CRED_USERS){
+		user = user * 10 + line[i++] - '0';
+	}
+	if(i == 6 || i >= len || line[i++] != ' ' || user >= CRED_USERS){
+		return 1;
+	}
+	if(len - i == 2 && memcmp(line + i, "ON", 2) == 0){
+		CRED_enable(user, 1);
+		AUDIT_log(AUDIT_USER_ON, user);
+	}
+	else if(len - i == 3 && memcmp(line + i, "OFF", 3) == 0){
+		CRED_enable(user, 0);
+		AUDIT_log(AUDIT_USER_OFF, user);
+	}
+	else if(len - i == PIN_LENGTH){
+		while(n < PIN_LENGTH && line[i] >= '0' && line[i] <= '9'){
+			digits[n++] = line[i++] - '0';
+		}
+		if(n == PIN_LENGTH){
+			CRED_set(user, digits);
+			AUDIT_log(AUDIT_USER_SET, user);
+		}
+	}
+	return 1;
+}
@@ -0,0 +1,27 @@
+#ifndef CRED_H
+#define CRED_H
+
+//credential store
+//CRED_USERS PINs of PIN_LENGTH digits, user 0 is the master PIN at
+//EEPROM_PASSWORD (the single PIN of the old layout), the staff users 1 and up
+//are records of a flag byte and the digits from CRED_BASE, a staff user is
+//enabled, disabled or empty (erased record)
+//the RAM index holds a bit mask of users per PIN position and digit, while a
+//PIN is entered the candidates of every position are kept, CRED_digit()
+//narrows them with one AND, a clear key only steps back one position, so the
+//cost per digit and of CRED_match() is the same for one user or 32, and it
+//does not depend on how many digits of a PIN were right
+//service port lines: "#USER n dddd" sets the PIN of user n (and enables a
+//staff user), "#USER n OFF" and "#USER n ON" disable and enable it
+
+#define CRED_NONE 0xFF //no user matches
+
+void CRED_load(void);
+void CRED_digit(unsigned char position, unsigned char digit);
+unsigned char CRED_match(unsigned char length);
+unsigned char CRED_find(const char* digits);
+void CRED_set(unsigned char user, const char* digits);
+void CRED_enable(unsigned char user, unsigned char on);
+unsigned char CRED_command(const char* line, unsigned char len);
+
+#endif
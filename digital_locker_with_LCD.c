@@ -1,463 +1,455 @@
 //included libraries
-#include <avr/io.h>
-#include <avr/interrupt.h>
-#include <avr/eeprom.h>
-#include <util/delay.h>
-
-//preprocessor directives, which define CPU frequnecy and PORT division
-//PORTA will be responsible for LCD data control
-//PORTB is connected to 4x4 keypad matrix and responsible for scanning that matrix
-//PORTC is declared as output PORT to control relay and buzzer
-//PORTD will be responsible for sending commands to LCD
-
-#define F_CPU 8000000UL
-#define LCD_DATA PORTA
-#define DATA_DDR DDRA
-#define MATRIX_DATA PORTB
-#define MATRIX_DDR DDRB
-#define OUT_PORT PORTC
-#define OUT_DDR DDRC
-#define LCD_CONTROL PORTD
-#define CONTROL_DDR DDRD
-
-//preprocessor directive which defines UART speed 
-#define BAUD_PRESCALE (((F_CPU / (UART_BAUDRATE * 16UL))) - 1)
-
-//pins PD4, PD5 and PD6 are responsible for shifting LCD screen between data
-//and control manipulation and for enabling communication 
-#define RS 4
-#define RW 5
-#define EN 6
-
-//PC5, PC6 and PC7 pins are connected to LEDs which indicates system state
-//blocked state system LED -> PC5
-//wait state system LED -> PD6
-//ready state system LED -> PD7
-#define BLOCKED 5
-#define WAIT 6
-#define READY 7
+#include "config.h"
+#include "hal.h"
+#include "lcd.h"
+#include "keypad.h"
+#include "uart.h"
+#include "tick.h"
+#include "gsm.h"
+#include "eeprom.h"
+#include "journal.h"
+#include "sched.h"
+#include "timer.h"
+#include "bench.h"
+#include "telem.h"
+#include "keymap.h"
+#include "cred.h"
+#include "audit.h"
+#include "sms.h"
+#include "alert.h"
+#include "sleep.h"
+#include "bus.h"
+#include "trace.h"
+
+//PORT division and pin assignments are declared in config.h
+
+#if PIN_LENGTH < 1 || PIN_LENGTH > 14
+#error "PIN_LENGTH digits have to fit the second LCD line from column 2"
+#endif
+#if EEPROM_PASSWORD + PIN_LENGTH > EEPROM_LEGACY_BLOCK
+#error "PIN digits overlap the legacy block flag in EEPROM"
+#endif
 
 //forward method declarations
-void PIN_init(void);
-void LCD_init(void);
-void LCD_send_command(unsigned char cmnd);
-void LCD_send_data(unsigned char data);
-void LCD_goto(unsigned char y, unsigned char x);
-void LCD_print(char* str);
-void LCD_clear(void);
-void LCD_blink(void);
-void UART_init(long UART_BAUDRATE);
-void show_digit(char digit);
-void UART_send_string(char string[50]);
-void UART_send_char(unsigned char a);
+void lock_init(void);
+void display(void);
 void get_key(void);
 void run_key_function(void);
 void verify_password(void);
 void send_sms(void);
-void GSM_init(void);
-void EEPROM_write(int addr, char data);
-void EEPROM_read(int addr);
+void gsm_initialization(void);
+void gsm_probe(void);
 void block_time(void);
 
 //system global variables
-char temp, column, key = 0, number[4] = {10,10,10,10}, index, password[4],temp1,digit;
-char show = 1, open = 0, match = 0, temp2, miss_match, temp4, block = 0;
-char contact_number[10] = {'0','9','9','8','7','4','2','9','2','5'};
+char key = 0, number[PIN_LENGTH], index,temp1,digit;
+char temp2;
 unsigned int wait;
 
-void PIN_init(){
+//lock state flags, packed into bitfields, lock_init() sets them
+struct lock_state{
+	unsigned char show : 1; //entered digits are shown, else '*'
+	unsigned char open : 1; //door is open
+	unsigned char match : 1; //last entered PIN matched
+	unsigned char block : 1; //system is blocked after 3 wrong PINs
+	unsigned char alarm : 1; //wrong password buzzer period is running
+	unsigned char gsm_ready : 1; //GSM module is configured
+	unsigned char miss_match : 2; //wrong PINs in a row, 0 - 3
+} lock;
+unsigned char user = CRED_NONE; //user of the last matching PIN
+
+//software timers of the lock logic
+struct TIMER alarm_timer, buzzer_timer, block_timer;
+
+//alerts raised before the GSM module answered are kept by the alert queue
+//and sent as soon as the initialization sequence is done
+unsigned long boot_ready_ms; //time from reset until the keypad is usable
+
+//start of the lockout for the telemetry, milliseconds
+unsigned long lockout_start;
+
+void get_key(void){
 	
-	//PIN_init() declares all PORTs as out/in and set the initial value into PORTs
-	//PORTA -> LCD DATA PORT which send 8bit frame data or command to LCD screen
-	//PORTB -> MATRIX PORT which controls 4x4 keypad rows and columns
-	//PORTC -> OUTPUT PORT which controls buzzer and relay state
-	//PORTD -> LCD_CONTROL PORT which controls communication with LCD (EN, RS and RW)
+	//get_key() function takes the key events queued by the keypad scanner and
+	//passes every key press to the run_key_function(), the scanner runs in the
+	//timer tick and debounces the keys, so nothing is lost or doubled while the
+	//main loop is busy, release events are not used
+	//key layout is KEYMAP_LAYOUT in config.h, by default row 1 (1, 2, 3, clear),
+	//row 2 (4, 5, 6, change), row 3 (7, 8, 9, set), row 4 (reset, 0, show, open)
 	
-	DATA_DDR = 0xFF; //declare LCD data PORT as output
-	LCD_DATA = 0x00; //initialise PORTA as hex 0x00
-	MATRIX_DDR = 0x0F; //initially DDRB, MATRIX_DDR is declared as hex 0x0F,
-	//matrix columns are connected to PORT pins PB0 - PB3, rows to PB4 - PB7
-	//columns are initially at HIGH state, rows at LOW state
-	MATRIX_DATA = 0x00;//PORTB initial value 0x00
-	OUT_DDR = 0xFF; //PORTC declared as output
-	OUT_PORT = 0x00; //initial value 0x00
-	CONTROL_DDR = 0xFF; //declare LCD command PORT as output
-	PORTD = 0x00; //initial PORTD value 0x00
+	unsigned char event;
+	while((event = KEYPAD_get_event()) != KEYPAD_NONE){
+		if(lock.block == 1){
+			continue; //keys are ignored while the system is blocked
+		}
+		if((event & KEYPAD_RELEASE) == 0){
+			key = event; //key value ranges from 1 to 16
+			TELEM_BEGIN(dispatch);
+			run_key_function();
+			TELEM_END(TELEM_DISPATCH, dispatch);
+			display();
+			key = 0; //setting key value out of range
+		}
+	}
+	if(LCD_idle()){
+		BENCH_cancel(BENCH_KEY_LCD); //keys did not change the display
+	}
+	BENCH_cancel(BENCH_KEY_RELAY); //keys did not switch the relay
 }
 
-void LCD_init(){
-	_delay_us(10);
-	LCD_send_command(0x38); //LCD initialization with 2 lines and 5*7 matrix
-	LCD_send_command(0x0E); //display on, cursor blinking
-	_delay_us(10); //wait for 10 microseconds
-	LCD_send_command(0x01); //clear LCD screen
-	_delay_us(10); //wait for 10 microseconds
+static void buzzer_off(unsigned char arg){
+	HAL_out_clear(0X02); //turn off the buzzer
 }
 
-void LCD_send_command(unsigned char cmnd){
-	LCD_DATA = cmnd;
-	LCD_CONTROL |= (0 << RW) | (0 << RS) | (1 << EN);
-	//RS pin is cleared because cmnd will be written in command register
-	_delay_us(10); //wait for 10 microseconds
-	LCD_CONTROL |= (0 << RW) | (0 << RS) | (0 << EN);
-	//disabling command sending
-	_delay_us(100); //wait for 100 microseconds
+static void alarm_end(unsigned char arg){
+	//end of the 2 seconds wrong password alarm
+	lock.alarm = 0;
+	HAL_out_clear(0X02); //turn off the buzzer
+	HAL_out_clear(0XE0); //turn off the LEDs
+	HAL_out_set(0X80); //ready indicator
+	display();
 }
 
-void LCD_send_data(unsigned char data){
-	LCD_DATA = data;
-	LCD_CONTROL |= (0 << RW) | (1 << RS) | (1 << EN);
-	//RS pin is set because data will be written in LCD data register
-	_delay_us(10); //wait for 10 microseconds
-	LCD_CONTROL |= (0 << RW) | (1 << RS) | (0 << EN);
-	//disabling command sending
-	_delay_us(100); //wait for 100 microseconds
+static void pin_clear(void){
+	//erase all digits, the next digit is the first one
+	for(temp2 = 0; temp2 < PIN_LENGTH; temp2++){
+		number[temp2] = PIN_EMPTY;
+	}
+	index = 0;
 }
 
-void LCD_goto(unsigned char y, unsigned char x){
-	unsigned char addr[] = {0x80, 0xC0 0x94, 0xD4};
-	LCD_send_command(addr[y - 1 + x - 1]); //force cursor to the (x,y) position
-	//x represent row (0 or 1), y represent character (0 to 15)
-	_delay_ms(10); //wait for 10 miliseconds
+static void key_digit(unsigned char digit){
+	if(index < PIN_LENGTH){ //digits beyond the PIN length are ignored
+		number[index] = digit;
+		CRED_digit(index, digit); //narrow the users the PIN can belong to
+		index++; //increment index variable
+	}
 }
 
-void LCD_print(char* str){
-	while(str > 0){ //wait while string pointer goes to the string end
-		LCD_send_data(*str++); //write a char and increment a pointer
+static void key_clear(unsigned char action){
+	if(index > 0){
+		index--; //decrement index variable
+		number[index] = PIN_EMPTY;
 	}
+	lock.match = 0;
 }
 
-void LCD_clear(){
-	LCD_send_command(0x01); //force LCD to clear all text from the screen
-	_delay_ms(100); //wait for 100 miliseconds
+static void key_change(unsigned char action){
+	if(lock.match == 1){ //if match variable is set
+		pin_clear(); //clear all password digits
+	}
 }
 
-void LCD_blink(){
-	LCD_send_command(0x08); //display and cursor off
-	_delay_ms(250); //wait for 10 miliseconds
-	LCD_send_command(0x0E); //display on, cursor blinking
-	_delay_ms(250); //wait for 10 miliseconds
+static void key_set(unsigned char action){
+	if(lock.match == 1 && index == PIN_LENGTH){ //check the match variable
+		//the new PIN of the user who opened the door is stored, the EEPROM
+		//bytes are queued and written by the EEPROM ready interrupt, the
+		//entered digits are matched again against the new index
+		CRED_set(user, number);
+		AUDIT_log(AUDIT_PIN_CHANGE, user);
+		for(temp2 = 0; temp2 < PIN_LENGTH; temp2++){
+			CRED_digit(temp2, number[temp2]);
+		}
+	}
 }
 
-void UART_init(long UART_BAUDRATE){
-	UCSRB |= (1 << RXEN) | (1 << TXEN) | (1 << RXCIE);
-	//enabling transreceiving and enabling interrupt on the RXC flag in UCSRA
-	UCSRC |= (1 << URSEL) | (1 << UCSZ0) | (1 << UCSZ1); //enabling URSEL enablae 
-	//frame bit changing, UCSZ0 and UCSZ1 set declare 8bit frame UART communication
-	UBBRL = BAUD_PRESCALE; //setting lower UART baud rate reg
-	UBBRH = (BAUD_PRESCALE >> 8); //setting upper UART baud rate reg
+static void key_reset(unsigned char action){
+	pin_clear();
+	HAL_out_clear(0x02); //turn off the buzzer
 }
 
-void get_key(void){
-	
-	//get_key() function  is used to read the pressed key and this information is 
-	//passed to the run_key_function(), refreshes the columns and reads the rows
-	//for detecting the pressed key, whenever a key is pressed this default value
-	//is replaced by the currently pressed key
-	
-	for(column = 1, temp = 1; column <= 4; temp *= 2, column++){
-		//column variable is setting offset picking 1st, 2nd, 3rd or 4th tactile sw
-		//column goes to 4 because there are four tactile switches
-		//temp variable is controlling active column
-		//temp is multiplies each time by 2 
-		//temp -> 0x01 -> column1
-		//temp -> 0x02 -> column2
-		//temp -> 0x04 -> column3
-		//temp -> 0x08 -> column4
-		
-		MATRIX_DATA &= 0xF0; //disable all columns without disturbing remaining pins
-		MATRIX_DATA |= temp; //enable particular column leaving remaining PORTB pins
-		switch(PINB & 0xF0){ //read rows data and identify the key
-			case 0x10:{ //if row 1 is activated (1, 2, 3, clear)
-				key = column; 
-			}	break; //exit from the switch
-			case 0x20:{ //if row 2 is activated (4, 5, 6, change)
-				key = 4 + column; 
-			} 	break; //exit from the switch
-			case 0x40:{ //if row3 is activated (7, 8, 9, set)
-				key = 8 + column;
-			}	break; //exit from the switch
-			case 0x80:{ //if row4 is activated (reset, 0, show/hide, open/close)
-				key = 12 + column;
-			}	break: //exit from the switch
+static void key_show(unsigned char action){
+	lock.show ^= 1; //show or hide the digits
+}
+
+static void key_open(unsigned char action){
+	verify_password(); //go to verification function
+	if(lock.match == 1){ //if password matches
+		if(lock.open == 0){ //if the door is closed
+			lock.open = 1; //update door status, door opened
+			AUDIT_log(AUDIT_OPEN, user);
+			HAL_out_set(0X01); //activate relay
+			BENCH_stop(BENCH_KEY_RELAY);
 		}
-		if(key > 0){
-			run_key_function();
-			do{
-				display();
-			}
-			while((PINB & 0xF0) != 0); //wait for keyrelease, any switch is pressed
-			key = 0; //setting key value out of range
+		else{ //if the door is opened
+			lock.open = 0; //update door status, door closed
+			AUDIT_log(AUDIT_CLOSE, user);
+			HAL_out_clear(0X01); //turn off the relay
+			BENCH_stop(BENCH_KEY_RELAY);
+			pin_clear(); //update the number array with default values
+			lock.match = 0; //update the match variable
 		}
+		lock.miss_match = 0; //if there are any missmatches before opening
 	}
+	else{ //if password does not match
+		lock.miss_match++; //there is miss match in guessing the password
+		AUDIT_log(lock.miss_match == 3 ? AUDIT_LOCKOUT : AUDIT_WRONG, CRED_NONE);
+		pin_clear(); //update the number array with default values
+		display();
+		if(lock.miss_match == 3){
+			//if the person does not guess the password 3 times in a row
+			lock.block = 1; //increment the block variable
+			lockout_start = TICK_now();
+			TIMER_cancel(&alarm_timer); //lockout replaces the wrong password alarm
+			lock.alarm = 0;
+			wait = 0; //lockout starts now
+			JOURNAL_update(lock.block, wait); //update the lock state journal
+			AUDIT_flush(0); //lockout record goes in with the journal
+			EEPROM_commit(); //blocked state is stored before the buzzer
+			HAL_out_set(0X02); //buzzer on
+			HAL_out_clear(0XE0); //turn off the LEDs
+			HAL_out_set(0X20); //blocked indicator
+			send_sms(); //send an SMS
+			TIMER_start(&buzzer_timer, 3000, 0); //about blocked condition
+			TIMER_start(&block_timer, 1000, 1000); //start lockout countdown
+		}
+		else{ //if wrong attempts is less than 3 times
+			lock.alarm = 1; //show the mismatch until the alarm ends
+			HAL_out_set(0X02); //turn on the buzzer
+			HAL_out_clear(0XE0); //turn off the LEDs
+			HAL_out_set(0X40); //wait indicator
+			TIMER_start(&alarm_timer, 2000, 0); //wait for 2 seconds
+		}
+	}
+	//the entry of an opening PIN stays, as the digits did in the old number
+	//array, so the next open/close press verifies it again and closes
 }
 
+//meaning of every key and handler of every meaning, see keymap.h
+static const unsigned char keymap[16] = KEYMAP_LAYOUT;
+static void (*const key_actions[KEY_ACTIONS])(unsigned char action) = {
+	key_digit, key_digit, key_digit, key_digit, key_digit,
+	key_digit, key_digit, key_digit, key_digit, key_digit,
+	key_clear, key_change, key_set, key_reset, key_show, key_open
+};
+
 void run_key_function(void){
 	
-	//switch statement with 16 cases, function is assigned with one case for each key
-	//as there are 16 keys in the keypad, key value ranges from 1 to 16 and by default
-	//the key value is set out of this range during initialization of the key variable
+	//the key code (1 to 16) is looked up in the keymap, its meaning selects the
+	//handler, digits are appended to the entered number, the other keys run
+	//their action, there is no branch on the key code
 	
-	switch(key){
-		case 1:{ // if key1 is pressed
-			number[index] = 1; //index position number in number array is 1
-			index++; //increment index variable
-		}	break; //exit from the switch
-		
-		case 2:{ //if key 2 is pressed
-			number[index] = 2;
-			index++; //increment index variable
-		}	break; //exit from the switch
-		
-		case 3:{ ////if key 3 is pressed
-			number[index] = 3;
-			index++; //increment index variable
-		}	break; //exit from the switch
-		
-		case 4:{ //if key clear is pressed
-			index--; //decrement index variable
-			number[index] = 10;
-			match = 0;
-		}	break; //exit from the switch
-		
-		case 5:{ //if key 4 is pressed
-			number[index] = 4;
-			index++; //increment index variable
-		}	break; //exit from the switch
-		
-		case 6:{ //if key 5 is pressed
-			number[index] = 5;
-			index++; //increment index variable
-		}	break; //exit from the switch
-		
-		case 7:{ //if key 6 is pressed
-			number[index] = 6;
-			index++; //increment index variable
-		}	break; //exit from the switch
-		
-		case 8:{ //if key change is pressed
-			if(match == 1){ //if match variable is set
-				for(temp2 = 0; temp2 <= 3; temp2++){
-					//clear all password digits
-					number[temp2] = 10;
-				}
-			}
-		}	break; //exit from the switch
-		
-		case 9:{ //if key 7 is pressed
-			number[index] = 7;
-			index++; //increment index variable
-		}	break; //exit from the switch
-		
-		case 10:{ //if key 8 is pressed
-			number[index] = 8;
-			index++; //increment index variable
-		}	break; //exit from the switch
-		
-		case 11:{
-			//key 11
-			number[index] = 9;
-			index++; //increment index variable
-		}	break; //exit from the switch
-		
-		case 12:{ //if key set is pressed
-			if(match == 1){ //check the match variable
-				for(temp2 = 0; temp2 <= 3; temp2++){
-					//password array digits (4) will be erased and set
-					//as numbers written in the number array
-                    password[temp2] = number[temp2];
-                }
-				//in EEPROM memory write new password 4-digit sequence
-                for(temp2 = 0; temp2 <= 3; temp2++){
-                    EEPROM_write(temp2,password[temp2]);
-                }
-            }
-
-		}	break; //exit from the switch
-		
-		case 13:{ //if key reset is pressed
-			index = 0; //index variable which stands as a number array pointer
-			for(temp2 = 0; temp2 <= 3; temp2++){
-				//erase all digits, update the number array with default values
-				number[temp2] = 10;
-			}
-			OUT_PORT &= 0xFD; //turn off the buzzer
-		}	break; //exit from the switch
-		
-		case 14:{ //if key 0 is pressed
-			number[index] = 0;
-			index++; //increment index variable
-		}	break; //exit from the switch
-		
-		case 15:{ //if key show/hide is pressed
-			show++; //increment show variable and do the modulo2 operation
-			show %= 2; //show variable is constrained with modulo operator
-			//it has an interval [0,1], prehaps it can be declared as a boolen
-		}	break; //exit from the switch
-		
-		case 16:{ //if key open/close is pressed
-			verify_password(); //go to verification function
-            if(match == 1) //if password matches
-            {
-				if(open == 0) //if the door is closed
-                {
-                    open = 1; //update door status, door opened
-                    OUT_PORT |= 0X01; //activate relay
-                }
-                else //if the door is opened
-                {
-                    open = 0;   //update door status, door closed
-                    OUT_PORT &= 0XFE; //turn off the relay
-                    for(temp2 = 0; temp2 <= 3; temp2++)
-                    { 
-						//update the number array with default values
-                        number[temp2]=10;
-                    }
-                    match = 0; //update the match variable
-                }    
-				//else the door will open if open key is pressed
-				miss_match=0; //if there are any missmatches before opening
-            }
-            else //if password does not match
-            {
-                miss_match++; //there is miss match in guessing the password
-                for(temp2 = 0; temp2 <= 3; temp2++)
-                {
-					//update the number array with default values
-                    number[temp2] = 10;
-                }
-                display();
-                if(miss_match == 3)
-                {
-					//if the person does not guess the password 3 times in a row
-                    block = 1; //increment the block variable
-                    OUT_PORT |= 0X02; //buzzer on
-					OUT_PORT &= 0X1F; //turn off the LEDs
-					OUT_PORT |= 0X20; //blocked indicator
-					send_sms(); //send an SMS
-					EEPROM_write(10,block); //update the EEPROM register
-					_delay_ms(3000); //about blocked condition
-					OUT_PORT &= 0XFD;  //turn off the buzzer after 3 seconds
-					TCCR1B = 0X0D;  //start timer
-                }
-                else //if wrong attempts is less than 3 times
-                {
-					OUT_PORT |= 0X02; //turn on the buzzer
-					OUT_PORT &= 0X1F; //turn off the LEDs
-					OUT_PORT |= 0X40; //wait indicator
-					_delay_ms(2000); //wait for 2 seconds
-					OUT_PORT &= 0XFD; //turn off the buzzer
-					OUT_PORT &= 0X1F; //turn off the LEDs
-					OUT_PORT |= 0X80; //ready indicator
-                }
-            }
-            index = 0;
-		}	break; //exit from the switch
-	}
+	unsigned char action = keymap[key - 1];
+	key_actions[action](action);
 }
 
 void verify_password(void){
 	
-	//entered number is read and stored in the array form, when a key corresponding
-	//to numbers 0 to 9 is pressed, the number is stored in the current address 
-	//location of the array and the address pointer is incremented through a variable
-	//index, so when next key is pressed, it is stored in EEPROM at next location
-	//array size is limited to 4 and entering beyond this limit leads to a run-time 
-	//error, so,before storing the entered digit the value od should be verified 
-	//whether it is less than or equal to 3 and this is optional
+	//the candidates were narrowed while the digits were entered (CRED_digit),
+	//so the verification costs the same for every number of users and for a
+	//PIN which is wrong in the first or in the last digit
 	
-	match = 1; //assume password matches
-	for(temp2 = 0; temp2 <= 3; temp2++){
-		//compare the data of each address location od entered number and password
-		if(number[temp2] != password[temp2]){
-			//if there is a miss match at any address location
-			match = 0; //password does not match
-			LCD_send_command(0x80); //force LCD cursor to first line
-			LCD_print("Pass not matches");
-			temp2 = 10; //exit from the loop
-		}
-	}
+	BENCH_start(BENCH_VERIFY);
+	user = CRED_match(index);
+	lock.match = user != CRED_NONE;
+	BENCH_stop(BENCH_VERIFY);
 }
 
 void display(void){
 	//there is an option to show or hide the password while entering, the display
 	//function uses one loop and it can be modifed easily if the number of digit is
 	//varied, if the show option == 1, then digits are shown as they are and if
-	//show option == 0, then the the LCD screen is blinking
-	for(digit = 4; digit >= 1; digit--){
-		if(number[digit-1] != 10){
-			if(show == 1){
-				LCD_send_command(0x80); //force LCD to 1st line
-				LCD_print("Enter_the_pass: ");
-				LCD_send_command(0xC2); //force LCD cursor to 2nd line and 3rd char
-				show_digit(number[digit - 1]); //show each digit 
-			}
+	//show option == 0, then every entered digit is shown as '*'
+	//display() only writes into the LCD framebuffer, unchanged characters cost
+	//no LCD bus traffic, so it can be called as often as needed
+	LCD_goto(0, 0); //force LCD to 1st line
+	if(lock.alarm){
+		LCD_print_P(HAL_PSTR("Pass not matches")); //during the wrong password alarm
+	}
+	else{
+		LCD_print_P(HAL_PSTR("Enter_the_pass: "));
+	}
+	LCD_goto(1, 2); //force LCD cursor to 2nd line and 3rd char
+	for(digit = 0; digit < PIN_LENGTH; digit++){
+		if(number[digit] == PIN_EMPTY){
+			LCD_put(' '); //digit is not entered yet
+		}
+		else if(lock.show == 1){
+			LCD_put('0' + number[digit]); //show each digit
 		}
+		else{
+			LCD_put('*'); //hide each digit
+		}
+	}
+}
+
+static void memory_report(void){
+	//RAM and flash budget for the service port, static RAM, RAM left for the
+	//stack at this point and flash image, in bytes
+	unsigned int ram, stack, flash;
+	HAL_memory(&ram, &stack, &flash);
+	UART_send_string_P(HAL_PSTR("#MEM ram="));
+	UART_send_number(ram);
+	UART_send_string_P(HAL_PSTR(" stack="));
+	UART_send_number(stack);
+	UART_send_string_P(HAL_PSTR(" flash="));
+	UART_send_number(flash);
+	UART_send_string_P(HAL_PSTR("\r\n"));
+}
+
+static void gsm_ready_done(unsigned char result){
+	//last command of the initialization sequence is done
+	if(result != GSM_OK){
+		gsm_probe(); //module did not take the settings, start over
+		return;
 	}
+	lock.gsm_ready = 1;
+	UART_send_string_P(HAL_PSTR("#BOOT ready=")); //boot-to-ready report for the service port
+	UART_send_number(boot_ready_ms);
+	UART_send_string_P(HAL_PSTR("ms gsm="));
+	UART_send_number(TICK_now());
+	UART_send_string_P(HAL_PSTR("ms\r\n"));
+	memory_report();
+	ALERT_modem(1); //alerts raised while the module was starting go out
 }
 
-void show_digit(char digit){
-	//show_digit() has one char parameter digit, in switch-case structure it is
-	//scanned which digit user wants to print, when one number is detected, it is
-	//printed on LCD screen with LCD_print() function calling
-	switch(digit){
-		case 1:{
-			LCD_print("1"); //print the string
-		}	break; //exit from the switch
-		case 2:{
-			LCD_print("2"); //print the string
-		}	break; //exit from the switch
-		case 3:{
-			LCD_print("3"); //print the string
-		}	break; //exit from the switch
-		case 4:{ 
-			LCD_print("4"); //print the string
-		}	break; //exit from the switch
-		case 5:{
-			LCD_print("5"); //print the string
-		}	break; //exit from the switch
-		case 6:{
-			LCD_print("6"); //print the string
-		}	break; //exit from the switch
-		case 7:{
-			LCD_print("7"); //print the string
-		}	break; //exit from the switch
-		case 8:{
-			LCD_print("8"); //print the string
-		}	break; //exit from the switch
-		case 9:{
-			LCD_print("9"); //print the string
-		}	break; //exit from the switch
-		case 0:{
-			LCD_print("0"); //print the string
-		}	break; //exit from the switch
-	}
-}
-
-void EEPROM_write(int addr, char data){
-	do{}
-	while((EECR & (0 << EEWE)) == 1); //wait while EEWE bit in EECR reg is clear
-	do{}
-	while((SPMCR & (0 << SPMEN)) == 1);//wait while SPMEN bit in SPMCR reg is clear
-	//set an address into lower and upper EEPROM address reg
-	EEARH = addr / 256; 
-	EEARL = addr % 256;
-	EEDR = data; //set the data into EEPROM data reg
-	EECR = (1 << EEMWE) | (0 << EEWE); //set the EEMWE and clear EEWE bits in EECR
-	EECR = (1 << EEMWE) | (1 << EEWE); //set the EEWE bit and data will be written
-	//in the EEPROM memory at the EEAR address
-}
-
-char EEPROM_read(int addr){
-	int data; 
-	do{}
-	while((EECR & (0 << EEWE)) == 1); //wait while EEWE in EECR is clear
-	//set the address where data is stored in EEPROM memory
-	EEARH = addr / 256;
-	EEARL = addr % 256;
-	EECR |= (1 << EERE); //write 1 to EERE to enable read operation from add
-	data = EEDR; //read EEDR reg
-	return data;
+static void service_line(const char* line, unsigned char len){
+	//requests on the service port, the telemetry, audit, trace and EEPROM
+	//frames are sent only while no AT command is in progress, so they can not
+	//end up in an SMS text, lines of the SMS channel are never service requests
+	if(SMS_line(line, len)){
+		return;
+	}
+	if(TELEM_requested(line, len) && GSM_idle()){
+		TELEM_send();
+	}
+	if(AUDIT_requested(line, len) && GSM_idle()){
+		AUDIT_send();
+	}
+	if(TRACE_requested(line, len) && GSM_idle()){
+		TRACE_send();
+	}
+	if(TRACE_image_requested(line, len) && GSM_idle()){
+		TRACE_image();
+	}
+	CRED_command(line, len); //staff PINs
+	ALERT_command(line, len); //alert recipients
+}
+
+static void unblock(unsigned char by){
+	//end of the lockout, the time is over (by is CRED_NONE) or the master
+	//user ended it by SMS
+	TIMER_cancel(&block_timer); //stop the countdown
+	wait = 0;
+	lock.block = 0; //system is unblocked or resumed
+	TELEM_record(TELEM_LOCKOUT, (TICK_now() - lockout_start) / 1000);
+	lock.miss_match = 0; //reset the miss_match counting variables 
+	JOURNAL_update(lock.block, wait); //unblocked state is written at once
+	AUDIT_log(AUDIT_UNBLOCK, by);
+	HAL_out_clear(0xE0); 
+	HAL_out_set(0x80);
+}
+
+static void sms_log(void){
+	//newest audit records that fit the answer, newest first, event,user@s
+	static const char names[][6] HAL_FLASH = {
+		"boot", "open", "close", "wrong", "lock", "unbl", "pin", "uset", "uoff", "uon", "sms", "lost"
+	};
+	unsigned char back, event, who;
+	unsigned long time;
+	SMS_reply_P(HAL_PSTR("log"));
+	for(back = 0; back < 8 && AUDIT_newest(back, &event, &who, &time); back++){
+		SMS_reply_P(HAL_PSTR(" "));
+		SMS_reply_P(event < sizeof(names) / sizeof(names[0]) ? names[event] : HAL_PSTR("?"));
+		if(who != CRED_NONE){
+			SMS_reply_P(HAL_PSTR(","));
+			SMS_reply_number(who);
+		}
+		SMS_reply_P(HAL_PSTR("@"));
+		SMS_reply_number(time / 1000);
+	}
+}
+
+static void sms_command(unsigned char command, const struct SMS_slice* arg){
+	
+	//command from the contact number with the master PIN, every command is
+	//answered with an SMS, a wrong PIN is only logged, so the sender learns
+	//nothing about it
+	
+	char digits[PIN_LENGTH];
+	unsigned char i;
+	if(command == SMS_DENIED){
+		AUDIT_log(AUDIT_SMS_DENIED, CRED_NONE);
+		return;
+	}
+	SMS_reply_begin();
+	if(command == SMS_STATUS){
+		SMS_reply_P(lock.open ? HAL_PSTR("door=open") : HAL_PSTR("door=closed"));
+		SMS_reply_P(lock.block ? HAL_PSTR(" blocked=") : HAL_PSTR(" ready wrong="));
+		SMS_reply_number(lock.block ? BLOCK_SECONDS - wait : lock.miss_match);
+		SMS_reply_P(HAL_PSTR(" up="));
+		SMS_reply_number(TICK_now() / 1000);
+	}
+	else if(command == SMS_UNBLOCK){
+		if(lock.block){
+			unblock(0);
+			SMS_reply_P(HAL_PSTR("unblocked"));
+		}
+		else{
+			SMS_reply_P(HAL_PSTR("not blocked"));
+		}
+	}
+	else if(command == SMS_PIN){
+		for(i = 0; i < PIN_LENGTH && i < arg->len && arg->text[i] >= '0' && arg->text[i] <= '9'; i++){
+			digits[i] = arg->text[i] - '0';
+		}
+		if(i == PIN_LENGTH && arg->len == PIN_LENGTH){
+			CRED_set(0, digits);
+			AUDIT_log(AUDIT_PIN_CHANGE, 0);
+			SMS_reply_P(HAL_PSTR("PIN changed"));
+		}
+		else{
+			SMS_reply_P(HAL_PSTR("PIN has to be "));
+			SMS_reply_number(PIN_LENGTH);
+			SMS_reply_P(HAL_PSTR(" digits"));
+		}
+	}
+	else if(command == SMS_LOG){
+		sms_log();
+	}
+	SMS_reply_send();
+}
+
+#if BUS_ADDRESS
+static void bus_command(unsigned char command, const unsigned char* args, unsigned char len){
+	
+	//command of the bus controller, there is no answer besides the audit
+	//events the command causes, which go back to the controller, a malformed
+	//command is ignored
+	
+	char digits[PIN_LENGTH];
+	unsigned char i;
+	if(command == BUS_UNBLOCK && lock.block){
+		unblock(0);
+	}
+	else if(command == BUS_PIN && len == PIN_LENGTH + 1 && args[0] < CRED_USERS){
+		for(i = 0; i < PIN_LENGTH && args[1 + i] <= 9; i++){
+			digits[i] = args[1 + i];
+		}
+		if(i == PIN_LENGTH){
+			CRED_set(args[0], digits);
+			AUDIT_log(AUDIT_USER_SET, args[0]);
+		}
+	}
+}
+#endif
+
+static void gsm_probe_done(unsigned char result){
+	if(result == GSM_OK){
+		gsm_initialization(); //module is up, configure it
+	}
+	else{
+		gsm_probe(); //still starting, ask again
+	}
+}
+
+void gsm_probe(void){
+	//the GSM module needs up to 15 seconds after power up before it accepts
+	//commands, instead of waiting that long "AT" is sent every GSM_PROBE_MS in
+	//the background until the module answers
+	lock.gsm_ready = 0;
+	ALERT_modem(0);
+	GSM_queue(HAL_PSTR("AT\r"), GSM_OK, GSM_PROBE_MS, 0, GSM_FLASH, gsm_probe_done);
 }
 
 void gsm_initialization(void){
@@ -466,56 +458,26 @@ void gsm_initialization(void){
 	//in real-time, the TTL level TXand RX pins of the GSM module are connected to uC
 	//the communication parameters are baud rate = 9600 bits per second,bitframe = 8bit
 	//no parity bit
+	//commands are queued in the AT command engine, each one is sent as soon as
+	//the modem answered OK to the previous one, a command is repeated twice on
+	//ERROR or timeout
 	
-    UART_send_string("ATE0\r\n"); //Disable echoing of commands
-    _delay_ms(500); //wait for 500 miliseconds
-    UART_send_string("AT+CMGF=1\r\n"); //Message format = text mode
-    _delay_ms(500); //wait for 500 miliseconds
-    UART_send_string("AT+CMGD=1,4\r\n"); //Delete all the messages
-    _delay_ms(500); //wait for 500 miliseconds
-    UART_send_string("AT+GSMBUSY=1\r\n");
-    _delay_ms(500); //Busy mode enabled to reject incoming calls
+	GSM_queue(HAL_PSTR("ATE0\r"), GSM_OK, 1000, 2, GSM_FLASH, 0); //Disable echoing of commands
+	GSM_queue(HAL_PSTR("AT+CMGF=1\r"), GSM_OK, 1000, 2, GSM_CHAINED | GSM_FLASH, 0); //Message format = text mode
+	GSM_queue(HAL_PSTR("AT+CMGD=1,4\r"), GSM_OK, 5000, 2, GSM_CHAINED | GSM_FLASH, 0); //Delete all the messages
+	GSM_queue(HAL_PSTR("AT+CNMI=2,1,0,0,0\r"), GSM_OK, 1000, 2, GSM_CHAINED | GSM_FLASH, 0); //+CMTI for every new message
+	GSM_queue(HAL_PSTR("AT+CSDH=1\r"), GSM_OK, 1000, 2, GSM_CHAINED | GSM_FLASH, 0); //text length in the +CMGL headers
+	GSM_queue(HAL_PSTR("AT+GSMBUSY=1\r"), GSM_OK, 1000, 2, GSM_CHAINED | GSM_FLASH, gsm_ready_done); //Busy mode enabled to reject incoming calls
 }
 
 void send_sms(void){
-	//through a series of commands, the concact number and the message are sent to the GSM
-	//module and the module sends the message
-	
-	gsm_initialization();
-	UART_send_string("AT + CMGS="); //command to send SMS
-	UART_send_char(""); //command format
-	for(temp4 = 0;temp4 <= 9; temp4++){
-		//send contact number
-		UART_send_char(contact_number[temp4]);
-	}
-	UART_send_char(""); //command format
-	UART_send_char(13); //command format 
-	_delay_ms(300); //wait for 300 miliseconds
-	UART_send_string("Alert:"); //send the text
-	UART_send_char(13); //new line indication=carriage return
-	UART_send_string("Wrong password is entered for 3 times"); //text
-	UART_send_char(13); //new line indication=carriage return
-	UART_send_string("System is blocked for one hour.");
-	UART_send_char(26); //command format indicating end of text and send SMS
-	UART_send_char(13); //command ending format
-	UART_send_char(10);
-}
-
-void UART_send_string(char string[50]){
-	for(temp4 = 0; string[temp4] != 0; temp4++){
-		UART_send_char(string[temp4]);
-	}
-}
-
-void UART_send_char(unsigned char a){
-	do{}
-	while((UCSRA & (1 << UDRE)) == 0); //wait UDRE to be set, then transmission is over
-	//buffer is empty and new transmission can be executed
-	UCSRA |= (1 << TXC); this flag is set when the entire frame from TX buffer is 
-	//shiffted out and ther is no new data currently present in the buffer (UDR)
-	UDR = a;
-	do{}
-	while((UCSRA & (1 << TXC)) == 0); //wait while TXC is not automatically cleared
+	//the alert goes into the alert queue (alert.h), which merges it with the
+	//alerts raised close to it, sends the message to every recipient through
+	//the GSM module and tries again if a send failed, the module is
+	//configured once by gsm_initialization() when it comes up
+	BENCH_start(BENCH_SMS);
+	ALERT_raise(ALERT_LOCKOUT);
+	BENCH_stop(BENCH_SMS);
 }
 
 void block_time(){
@@ -526,69 +488,149 @@ void block_time(){
 	//and the time passed after blocking the system should be stored in the EEPROM
 	//after every reset or the normal switch on the system, this information is read
 	//and if the system is previously under a blocced state then,this blocking continues
-	//for its remaining time and then the system resumes, the EEPROM related operations
-	//are performed in the interrupt sub routine od compare match interruput od the 
-	//16bit timer
+	//for its remaining time and then the system resumes
+	//block_time() is called from the main loop once every second by the
+	//periodic block_timer, the state is kept
+	//in the journal, which writes it into EEPROM every JOURNAL_CHECKPOINT seconds
 	
 	wait++; //increment seconds count
-	if(wait == 10){ //blocking time = 10 sec, it can be up to 65,535 seconds
-		TCCR1B = 0x00; //stop the timer
-		wait = 0; //if the blocking time is completed
-		block = 0; //system is unblocked or resumed
-		miss_match = 0; //reset the miss_match counting variables 
-		EEPROM_write(10,block); //update EEPROM register
-		EEPROM_write(11,0);
-		EEPROM_write(12,0);
-		OUT_PORT &= 0x1F; 
-		OUT_PORT |= 0x80;
+	if(wait >= BLOCK_SECONDS){ //blocking time, it can be up to 65,535 seconds
+		unblock(CRED_NONE); //if the blocking time is completed
 	}
 	else{
-		//if blocking time is not completed, update EEPROM register
-		EEPROM_write(11, wait % 256); 
-		EEPROM_write(12, wait % 256);
+		//if blocking time is not completed, update the journal
+		JOURNAL_update(lock.block, wait);
 	}
 }
 
-int main(void){
-	PIN_init(); //initilise PORTs
+static void key_handler(unsigned char arg){
+	BENCH_start(BENCH_KEY);
+	get_key(); //keypad events are queued
+	BENCH_stop(BENCH_KEY);
+}
+
+#if BENCH && !defined(HAL_HOST)
+//periodic report, on the host lock_bench reads the statistics itself and the
+//armed timer would keep the lock out of power-down
+static struct TIMER bench_timer;
+
+static void bench_report(unsigned char arg){
+	//the service port is the modem UART, a report sent while a command waits
+	//for its answer would go into the modem, so it waits until the modem is idle
+	if(!GSM_idle()){
+		TIMER_start(&bench_timer, 100, BENCH_REPORT_MS); //tried again in 100 ms
+		return;
+	}
+	BENCH_report(); //periodic benchmark report on the service port
+}
+#endif
+
+static void block_tick(unsigned char arg){
+	block_time(); //one second of the lockout passed
+}
+
+static void rx_handler(unsigned char arg){
+#if BUS_ADDRESS
+	BUS_poll(); //poll of the controller
+#else
+	GSM_poll(); //modem answered
+#endif
+	SLEEP_busy(); //no power-down in the middle of a line
+}
+
+
+void lock_init(void){
+	
+	//lock_init() brings up the drivers and restores the lock state, after it
+	//the lock runs from SCHED_run(), main() on the ATmega and the host runner
+	//share it, the lock variables are set here and not only by their
+	//initializers, so the simulator can boot the firmware again after a
+	//power cut
+	
+	key = 0;
+	index = 0;
+	for(temp1 = 0; temp1 < PIN_LENGTH; temp1++){
+		number[temp1] = PIN_EMPTY;
+	}
+	lock.show = 1;
+	lock.open = 0;
+	lock.match = 0;
+	user = CRED_NONE;
+	lock.miss_match = 0;
+	lock.block = 0;
+	wait = 0;
+	lock.alarm = 0;
+	lock.gsm_ready = 0;
+	HAL_init(); //initilise PORTs
+	SCHED_init(); //no signals, no tasks
+	TIMER_init(); //empty timer wheel
+	SLEEP_init(); //no wake-up pending
+	TRACE_init(); //empty trace, the first record is the first tick
 	LCD_init(); //initialise LCD screen
-	//1 second equivalent imported in Timer1 output compare register
-	OCR1AH = 0x3D;
-	OCR1AL = 0x09; 
-	TIMSK |= (1 << OCIE1A); //enable Timer1 output compare match interrupt
-	//interrupt will be executed if I bit in SREG is enabled and when a compare 
-	//match in TImer1 occurs, when OCF1A is set in TIFR register
-	SREG |= 0x80; //write hex 0x80 into SREG, enabling  I bit which causses enabling
-	//global interrupt, also it cane be written as SREG |= (1 << I);
+	KEYPAD_init(); //start scanning from the first column
+	TICK_init(); //start 1 ms system tick which flushes the LCD framebuffer
+	TIMER_setup(&alarm_timer, alarm_end, 0);
+	TIMER_setup(&buzzer_timer, buzzer_off, 0);
+	TIMER_setup(&block_timer, block_tick, 0);
+	BENCH_init(); //empty benchmark statistics
+	TELEM_init(); //empty telemetry counters
+#if BENCH && !defined(HAL_HOST)
+	TIMER_setup(&bench_timer, bench_report, 0);
+	TIMER_start(&bench_timer, BENCH_REPORT_MS, BENCH_REPORT_MS);
+#endif
+	HAL_irq_enable(); //enable global interrupts
+#if BUS_ADDRESS
+	UART_init(BUS_BAUDRATE); //RS-485 line of the doors
+	BUS_init(bus_command); //empty event queue, the controller learns of the boot
+#else
 	UART_init(9600); //declare baudrate at 9600 bits per second
-	OUT_PORT |= (1 << WAIT); //wait LED is at HIGH state
-	delay_ms(15000); //waiting for GSM module start up
-	for(temp1 = 0; temp1 <= 3; temp1++){
-		password[temp1] = EEPROM_read(temp1);
-	}
-	block = EEPROM_read(10);
-	if(block == 1){
+#endif
+	GSM_init(); //empty AT command queue
+	GSM_on_line(service_line); //requests on the service port
+	SMS_init(sms_command); //commands from the contact number
+	ALERT_init(); //empty alert queue, nothing is sent before the modem is up
+	EEPROM_init(); //empty EEPROM write queue
+#if !BUS_ADDRESS
+	gsm_probe(); //GSM module is brought up in the background
+#endif
+	CRED_load(); //PIN index of all users
+	JOURNAL_load(); //restore the lock state from the journal
+	AUDIT_load(); //find the end of the audit log
+#if BUS_ADDRESS
+	//on the bus the events go to the controller, it sends the alerts of the
+	//lockouts, the alert queue of the door never sees a modem
+	AUDIT_on_log(BUS_event);
+#endif
+	AUDIT_log(AUDIT_BOOT, CRED_NONE);
+	lock.block = JOURNAL_cache.block;
+	if(lock.block == 1){
 		//if block variable is 1
-		OUT_PORT &= (0 << WAIT); //wait LED is at LOW state
-		OUT_PORT |= (1 << BLOCKED); //blocked LED is at HIGH state
-		wait = EEPROM_read(11); //time lapse after blocking
-		wait *= 256; //multiplay wait variable value with 256
-		temp1 = EEPROM_read(12);
-		wait += temp1;
-		TCCR1B = 0x0D; //setting CS12 and CS10 causses clk/1024 prescale rate
-		//CTC mode selected with setting WGM12 at HIGH state, eventually timer starts
+		HAL_out_set(1 << BLOCKED); //blocked LED is at HIGH state
+		wait = JOURNAL_cache.wait; //time lapse after blocking
+		lockout_start = TICK_now() - wait * 1000UL; //before the power cut
+		TIMER_start(&block_timer, 1000, 1000); //continue the lockout countdown
+		ALERT_raise(ALERT_RESUMED); //power was cut or the lock was reset while blocked
 	}
 	else{
 		//if block variable is 0
 		//ready LED, wait LED and blocked LED are at LOW state
-		OUT_PORT &= (0 << READY) | (0 << WAIT) | (0 << BLOCKED); 
+		HAL_out_clear((1 << READY) | (1 << WAIT) | (1 << BLOCKED)); 
 		//ready LED is at HIGH state
-		OUT_PORT |= (1 << READY); 
+		HAL_out_set(1 << READY); 
 	}
+	boot_ready_ms = TICK_now(); //keypad, LCD and lock logic are ready
+	SCHED_on(SCHED_KEY, key_handler);
+	SCHED_on(SCHED_TIMER, TIMER_service);
+	SCHED_on(SCHED_RX, rx_handler);
+	display();
+}
+
+#ifndef HAL_HOST
+int main(void){
+	lock_init();
 	while(1){ //do it forever
-		if(block == 0){ //check block variable
-			get_key();
-			display();
-		}
+		SCHED_run(); //event dispatch loop, nothing in it waits
+		SLEEP_enter(); //until the next interrupt if there is nothing to do
 	}
 }
+#endif
@@ -0,0 +1,110 @@
+//included libraries
+#include "config.h"
+#include "hal.h"
+#include "eeprom.h"
+#include "bench.h"
+#include "telem.h"
+#include "tick.h"
+#include "trace.h"
+
+struct EEPROM_entry{
+	unsigned int addr;
+	unsigned char data;
+};
+
+//write queue, EEPROM_head is written only by the main loop and EEPROM_tail
+//only by the EEPROM ready interrupt
+static volatile struct EEPROM_entry EEPROM_queue[EEPROM_QUEUE];
+static volatile unsigned char EEPROM_head, EEPROM_tail;
+
+void EEPROM_init(void){
+	EEPROM_head = 0;
+	EEPROM_tail = 0;
+}
+
+void EEPROM_write(int addr, char data){
+	//enqueue one byte, the call waits only while the queue is full
+	unsigned char next = (EEPROM_head + 1) & (EEPROM_QUEUE - 1);
+	TELEM_BEGIN(start);
+	BENCH_start(BENCH_EEPROM);
+	while(next == EEPROM_tail){ //wait for the interrupt to free a slot
+		HAL_spin();
+	}
+	EEPROM_queue[EEPROM_head].addr = addr;
+	EEPROM_queue[EEPROM_head].data = data;
+	EEPROM_head = next; //publish the entry after it is stored
+	HAL_eeprom_irq(1); //enable EEPROM ready interrupt
+	BENCH_stop(BENCH_EEPROM);
+	TELEM_END(TELEM_EEPROM, start);
+}
+
+char EEPROM_read(int addr){
+	
+	//EEPROM_read() searches the queue from the newest entry, a queued value is
+	//returned without touching the EEPROM, otherwise the cell is read as soon
+	//as no write is in progress, the search and the read are done with
+	//interrupts disabled, so the interrupt can not start a write in between
+	
+	unsigned char i;
+	char data;
+	while(1){
+		HAL_ATOMIC{
+			for(i = EEPROM_head; i != EEPROM_tail;){
+				i = (i - 1) & (EEPROM_QUEUE - 1);
+				if(EEPROM_queue[i].addr == (unsigned int)addr){
+					return EEPROM_queue[i].data; //pending value
+				}
+			}
+			if(!HAL_eeprom_busy()){
+				data = HAL_eeprom_read(addr);
+				return data;
+			}
+		}
+		HAL_spin();
+	}
+}
+
+void EEPROM_commit(void){
+	//barrier, wait until every queued byte is in the EEPROM, used for state
+	//which has to survive a power cut before the relay or buzzer is switched
+#if TELEM
+	unsigned long start = TICK_now(); //a full queue takes longer than 65 ms
+#endif
+	while(EEPROM_head != EEPROM_tail){
+		HAL_spin();
+	}
+	while(HAL_eeprom_busy()){ //last write cycle takes up to 8.5 ms
+		HAL_spin();
+	}
+	TELEM_record(TELEM_COMMIT, TICK_now() - start);
+}
+
+unsigned char EEPROM_pending(void){
+	//number of queued bytes
+	return (EEPROM_head - EEPROM_tail) & (EEPROM_QUEUE - 1);
+}
+
+void EEPROM_isr(void){
+	
+	//called from the EEPROM ready interrupt, which is active as long as no
+	//write is in progress, so it is entered again right after a write cycle
+	//ends or an entry is skipped, with an empty queue the interrupt disables
+	//itself
+	
+	volatile struct EEPROM_entry* entry;
+	unsigned char old;
+	if(EEPROM_tail == EEPROM_head){
+		HAL_eeprom_irq(0);
+		return;
+	}
+	if(HAL_eeprom_busy()){
+		return; //self programming in progress, try again
+	}
+	entry = &EEPROM_queue[EEPROM_tail];
+	old = HAL_eeprom_read(entry->addr);
+	if(old != entry->data){
+		TRACE_eeprom(entry->addr, old, entry->data);
+		HAL_eeprom_write(entry->addr, entry->data); //unchanged cells are skipped
+	}
+	EEPROM_tail = (EEPROM_tail + 1) & (EEPROM_QUEUE - 1);
+}
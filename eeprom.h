@@ -0,0 +1,16 @@
+#ifndef EEPROM_H
+#define EEPROM_H
+
+//internal EEPROM access with an interrupt driven write queue
+//EEPROM_write() only enqueues the byte, the EEPROM ready interrupt writes the
+//queued bytes one after another and skips bytes which already hold the value
+//EEPROM_read() returns the newest queued value of an address, so a read always
+//sees the previous writes, EEPROM_commit() waits until everything is written
+
+void EEPROM_init(void);
+void EEPROM_write(int addr, char data);
+char EEPROM_read(int addr);
+void EEPROM_commit(void);
+unsigned char EEPROM_pending(void);
+
+#endif
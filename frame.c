@@ -0,0 +1,46 @@
+//included libraries
+#include "config.h"
+#include "frame.h"
+#include "uart.h"
+#include "trace.h"
+
+static unsigned char FRAME_crc; //CRC of the frame being sent
+
+unsigned char FRAME_crc8(unsigned char crc, unsigned char b){
+	//CRC of the frame bytes so far and b, for frames built in a buffer
+	unsigned char bit;
+	crc ^= b;
+	for(bit = 0; bit < 8; bit++){
+		crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+	}
+	return crc;
+}
+
+void FRAME_byte(unsigned char b){
+	UART_send_char(b);
+	FRAME_crc = FRAME_crc8(FRAME_crc, b);
+}
+
+void FRAME_word(unsigned int w){
+	FRAME_byte(w);
+	FRAME_byte(w >> 8);
+}
+
+void FRAME_long(unsigned long l){
+	FRAME_word(l);
+	FRAME_word(l >> 16);
+}
+
+void FRAME_begin(unsigned char type, unsigned int len){
+	//the caller sends exactly len payload bytes before FRAME_end()
+	TRACE_quiet(1);
+	UART_send_char(FRAME_SYNC);
+	FRAME_crc = 0;
+	FRAME_byte(type);
+	FRAME_word(len);
+}
+
+void FRAME_end(void){
+	UART_send_char(FRAME_crc);
+	TRACE_quiet(0);
+}
@@ -0,0 +1,27 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+//binary frames on the service port (UART)
+//0x7E, type, payload length (2 bytes), payload, CRC-8 of everything after the
+//0x7E, the CRC is the one of the journal records (polynomial x^8 + x^2 + x + 1)
+//multi byte fields are little endian, the length is given up front, so a
+//frame is streamed without buffering the payload
+
+#define FRAME_SYNC 0x7E
+
+//frame types
+#define FRAME_TELEM 'T' //telemetry (telem.h)
+#define FRAME_AUDIT 'A' //audit log (audit.h)
+#define FRAME_POLL 'P' //bus, controller to door (bus.h)
+#define FRAME_REPLY 'R' //bus, door to controller (bus.h)
+#define FRAME_TRACE 'X' //input trace (trace.h)
+#define FRAME_EEPROM 'E' //EEPROM image (trace.h)
+
+unsigned char FRAME_crc8(unsigned char crc, unsigned char b);
+void FRAME_begin(unsigned char type, unsigned int len);
+void FRAME_byte(unsigned char b);
+void FRAME_word(unsigned int w);
+void FRAME_long(unsigned long l);
+void FRAME_end(void);
+
+#endif
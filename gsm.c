@@ -0,0 +1,240 @@
+//included libraries
+#include "config.h"
+#include <string.h>
+#include "gsm.h"
+#include "uart.h"
+#include "timer.h"
+
+//engine states
+#define GSM_IDLE 0 //nothing sent, next queued command can be sent
+#define GSM_WAIT 1 //command sent, waiting for the answer
+#define GSM_BACKOFF 2 //command failed, waiting before it is sent again
+
+struct GSM_cmd{
+	const char* text; //command text including the terminating CR or Ctrl-Z
+	GSM_done_fn done; //called with the result, may be 0
+	unsigned int timeout; //milliseconds to wait for the answer
+	unsigned char expect; //answers which complete the command successfully
+	unsigned char retries; //times the command is sent again after a failure
+	unsigned char flags;
+};
+
+//command queue, GSM_q[GSM_tail] is the command in progress
+static struct GSM_cmd GSM_q[GSM_QUEUE];
+static unsigned char GSM_head, GSM_tail;
+static unsigned char GSM_state;
+static unsigned char GSM_failed; //previous command failed, skip chained ones
+static unsigned char GSM_kicked; //GSM_poll() is posted to the scheduler
+static struct TIMER GSM_timer; //answer timeout or end of the backoff
+
+//modem answer line being received
+static char GSM_line[GSM_LINE];
+static unsigned char GSM_len;
+static GSM_line_fn GSM_line_handler; //lines which are not final answers
+static GSM_line_fn GSM_data_handler; //lines of the announced data
+static unsigned int GSM_data_left; //data bytes still to come
+static unsigned char GSM_data_lf; //LF of the announcing line not seen yet
+
+static void GSM_fail(unsigned char result);
+
+static void GSM_kick(unsigned char arg){
+	GSM_kicked = 0;
+	GSM_poll();
+}
+
+static void GSM_expired(unsigned char arg){
+	//the modem did not answer in time or the backoff is over
+	if(GSM_state == GSM_WAIT){
+		GSM_fail(GSM_TIMEOUT);
+	}
+	else if(GSM_state == GSM_BACKOFF){
+		GSM_state = GSM_IDLE; //send the failed command again
+	}
+	GSM_poll();
+}
+
+void GSM_init(void){
+	GSM_head = 0;
+	GSM_tail = 0;
+	GSM_state = GSM_IDLE;
+	GSM_failed = 0;
+	GSM_kicked = 0;
+	GSM_len = 0;
+	GSM_line_handler = 0;
+	GSM_data_left = 0;
+	TIMER_setup(&GSM_timer, GSM_expired, 0);
+}
+
+void GSM_on_line(GSM_line_fn handler){
+	GSM_line_handler = handler;
+}
+
+void GSM_data(unsigned int n, GSM_line_fn handler){
+	//the bytes after the line end of the current line are data
+	GSM_data_left = n;
+	GSM_data_lf = 1;
+	GSM_data_handler = handler;
+}
+
+static void GSM_datum(unsigned char c){
+	
+	//GSM_datum() takes one byte of announced data, CR and LF in it split
+	//lines as well, the last byte ends the last line
+	
+	GSM_data_left--;
+	if(c != '\r' && c != '\n' && GSM_len < GSM_LINE - 1){
+		GSM_line[GSM_len++] = c;
+	}
+	if((c == '\r' || c == '\n' || GSM_data_left == 0) && GSM_len > 0){
+		GSM_line[GSM_len] = 0;
+		GSM_data_handler(GSM_line, GSM_len);
+		GSM_len = 0;
+	}
+}
+
+unsigned char GSM_queue(const char* text, unsigned char expect, unsigned int timeout,
+	unsigned char retries, unsigned char flags, GSM_done_fn done){
+	
+	//append a command to the queue, text is not copied and has to stay valid
+	//until the command is done, returns 0 if the queue is full
+	
+	unsigned char next = (GSM_head + 1) & (GSM_QUEUE - 1);
+	struct GSM_cmd* cmd;
+	if(next == GSM_tail){
+		return 0; //queue is full
+	}
+	cmd = &GSM_q[GSM_head];
+	cmd->text = text;
+	cmd->done = done;
+	cmd->timeout = timeout;
+	cmd->expect = expect;
+	cmd->retries = retries;
+	cmd->flags = flags;
+	GSM_head = next;
+	if(GSM_state == GSM_IDLE && !GSM_kicked){
+		GSM_kicked = SCHED_post(GSM_kick, 0); //send it from the main loop
+	}
+	return 1;
+}
+
+static void GSM_finish(unsigned char result){
+	//the command in progress is done, remove it and report the result
+	GSM_done_fn done = GSM_q[GSM_tail].done;
+	GSM_failed = (result & GSM_q[GSM_tail].expect) == 0;
+	GSM_tail = (GSM_tail + 1) & (GSM_QUEUE - 1);
+	GSM_state = GSM_IDLE;
+	TIMER_cancel(&GSM_timer);
+	if(done != 0){
+		done(result);
+	}
+}
+
+static void GSM_fail(unsigned char result){
+	//ERROR answer or timeout, send the command again after GSM_RETRY_MS if it
+	//has retries left, otherwise report the failure
+	if(GSM_q[GSM_tail].retries > 0){
+		GSM_q[GSM_tail].retries--;
+		GSM_state = GSM_BACKOFF;
+		TIMER_start(&GSM_timer, GSM_RETRY_MS, 0);
+	}
+	else{
+		GSM_finish(result);
+	}
+}
+
+static void GSM_match(void){
+	//a complete answer line is in GSM_line, compare it with the final result
+	//codes, every other line (echo, +CMGS: reference, URCs) goes to the line
+	//handler
+	if(GSM_state == GSM_WAIT){
+		if(strcmp(GSM_line, "OK") == 0){
+			if(GSM_q[GSM_tail].expect & GSM_OK){
+				GSM_finish(GSM_OK);
+			}
+			return;
+		}
+		if(strcmp(GSM_line, "ERROR") == 0 || strncmp(GSM_line, "+CME ERROR", 10) == 0
+			|| strncmp(GSM_line, "+CMS ERROR", 10) == 0){
+			GSM_fail(GSM_ERROR);
+			return;
+		}
+	}
+	if(GSM_line_handler != 0){
+		GSM_line_handler(GSM_line, GSM_len);
+	}
+}
+
+void GSM_rx(unsigned char c){
+	
+	//GSM_rx() assembles received bytes into lines, CR and LF end a line, the
+	//SMS text prompt '>' is not followed by a line end, so it is matched as
+	//soon as it arrives at the start of a line
+	
+	if(GSM_data_left != 0){
+		if(GSM_data_lf && c == '\n'){
+			GSM_data_lf = 0; //end of the announcing line
+			return;
+		}
+		GSM_data_lf = 0;
+		GSM_datum(c);
+		return;
+	}
+	if(c == '\r' || c == '\n'){
+		if(GSM_len > 0){
+			GSM_line[GSM_len] = 0;
+			GSM_match();
+			GSM_len = 0;
+		}
+		return;
+	}
+	if(GSM_len < GSM_LINE - 1){
+		GSM_line[GSM_len++] = c; //longer lines are truncated
+	}
+	if(c == '>' && GSM_len == 1 && GSM_state == GSM_WAIT
+		&& (GSM_q[GSM_tail].expect & GSM_PROMPT)){
+		GSM_len = 0;
+		GSM_finish(GSM_PROMPT);
+	}
+}
+
+void GSM_poll(void){
+	
+	//GSM_poll() runs for every received byte, when a command is queued and when
+	//the timer of the command in progress expires, it never waits, received
+	//bytes are processed first, then the next command is sent if the engine
+	//is idle
+	
+	unsigned char c;
+	struct GSM_cmd* cmd;
+	while(UART_receive(&c)){
+		GSM_rx(c);
+	}
+	while(GSM_state == GSM_IDLE && GSM_tail != GSM_head){
+		cmd = &GSM_q[GSM_tail];
+		if((cmd->flags & GSM_CHAINED) && GSM_failed){
+			GSM_finish(GSM_ABORTED); //previous part of the sequence failed
+			continue;
+		}
+		GSM_len = 0; //drop any partial line, the answer starts now
+		GSM_data_left = 0; //and data which never came in full
+		if(cmd->flags & GSM_FLASH){
+			UART_send_string_P(cmd->text);
+		}
+		else{
+			UART_send_string(cmd->text);
+		}
+		TIMER_start(&GSM_timer, cmd->timeout, 0);
+		GSM_state = GSM_WAIT;
+	}
+}
+
+unsigned char GSM_idle(void){
+	//true if there is no command queued or in progress
+	return GSM_state == GSM_IDLE && GSM_tail == GSM_head;
+}
+
+unsigned char GSM_free(void){
+	//number of commands which can be queued, a caller with commands chained
+	//to each other checks it first, so none of them is queued alone
+	return (GSM_tail - GSM_head - 1) & (GSM_QUEUE - 1);
+}
@@ -0,0 +1,47 @@
+#ifndef GSM_H
+#define GSM_H
+
+//asynchronous AT command engine for the GSM module
+//commands are queued with the answers they expect and a timeout, GSM_poll()
+//is called from the main loop, it takes the received bytes out of the UART
+//receive ring, splits them into lines, matches OK, ERROR and the '>' SMS text
+//prompt against the command in progress and sends the next command as soon as
+//the modem has answered, timeouts are software timers, the engine uses only
+//uart.h, timer.h and sched.h, so it can be linked on a workstation against a
+//scripted fake modem
+
+//answers, a command succeeds when the answer is in its expect mask
+#define GSM_OK 0x01
+#define GSM_ERROR 0x02
+#define GSM_PROMPT 0x04
+#define GSM_TIMEOUT 0x08
+#define GSM_ABORTED 0x10 //chained command skipped after a failure
+
+//command flags
+#define GSM_CHAINED 0x01 //sent only if the previous command succeeded
+#define GSM_FLASH 0x02 //text is a string in flash (HAL_PSTR)
+
+typedef void (*GSM_done_fn)(unsigned char result);
+
+//every received line which is not the final answer of the command in progress
+//(echo, +CMTI and other URCs, requests on the service port) is passed to the
+//line handler, line points into the receive buffer and is valid only during
+//the call
+typedef void (*GSM_line_fn)(const char* line, unsigned char len);
+
+//GSM_data() is called by a line handler when the line announces n bytes of
+//data (the text of a message), they are split into lines for the given
+//handler and never matched against the final result codes, so a text line
+//"OK" does not end the command in progress
+
+void GSM_init(void);
+unsigned char GSM_queue(const char* text, unsigned char expect, unsigned int timeout,
+	unsigned char retries, unsigned char flags, GSM_done_fn done);
+void GSM_on_line(GSM_line_fn handler);
+void GSM_data(unsigned int n, GSM_line_fn handler);
+void GSM_rx(unsigned char c);
+void GSM_poll(void);
+unsigned char GSM_idle(void);
+unsigned char GSM_free(void);
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef HAL_H
+#define HAL_H
+
+//hardware abstraction layer
+//every access to the ATmega peripherals goes through these functions, the
+//drivers and the lock logic never touch a register, hal_avr.c implements them
+//on the ATmega and holds the interrupt vectors, host/hal_host.c emulates the
+//peripherals in memory, so the same firmware runs on a workstation when it is
+//built with HAL_HOST defined
+//interrupt entry points of the drivers, called by the backend from the
+//interrupt vectors (or by the emulator): TICK_isr(), UART_tx_next(),
+//UART_rx_byte(), EEPROM_isr() and SLEEP_isr()
+//constant strings and tables stay in flash, HAL_FLASH places a const object
+//in program memory, HAL_PSTR() a string literal inside a function, a flash
+//pointer is read only with HAL_flash_byte() (LCD_print_P(), UART_send_string_P())
+
+#ifdef HAL_HOST
+//host backend runs the firmware and the emulated interrupts in one thread, an
+//interrupt never preempts the code, so an atomic block is an ordinary block
+//and a busy wait has to let the emulated time pass, HAL_spin() is called in
+//every busy wait loop of the drivers, flash is ordinary memory
+#define HAL_ATOMIC for(unsigned char HAL_once = 1; HAL_once; HAL_once = 0)
+void HAL_spin(void);
+#define HAL_FLASH
+#define HAL_PSTR(s) (s)
+#define HAL_flash_byte(p) (*(const unsigned char*)(p))
+#else
+#include <util/atomic.h>
+#include <avr/pgmspace.h>
+#define HAL_ATOMIC ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+#define HAL_spin()
+#define HAL_FLASH PROGMEM
+#define HAL_PSTR(s) PSTR(s)
+#define HAL_flash_byte(p) pgm_read_byte(p)
+#endif
+
+//PORTs and interrupts
+void HAL_init(void);
+void HAL_irq_enable(void);
+void HAL_irq_disable(void);
+
+//sleep, called with interrupts disabled, enables them and sleeps until an
+//interrupt, in HAL_SLEEP_IDLE the clocks run and the tick, the UART and the
+//EEPROM wake the CPU, in HAL_SLEEP_DOWN all clocks stop, the keypad columns
+//are pulled up with the rows driven low, so a pressed key (or the start bit
+//of a byte on RXD) pulls INT0 low and only that wakes the CPU, the byte
+//itself is lost, SLEEP_isr() is called from the INT0 interrupt
+#define HAL_SLEEP_IDLE 0
+#define HAL_SLEEP_DOWN 1
+void HAL_sleep(unsigned char mode);
+
+//output PORT, relay, buzzer and the state LEDs
+void HAL_out_set(unsigned char mask);
+void HAL_out_clear(unsigned char mask);
+unsigned char HAL_out_get(void);
+
+//keypad matrix, drive one column (0 to 3) and read the rows (bit 0 = row 1)
+void HAL_matrix_column(unsigned char column);
+unsigned char HAL_matrix_rows(void);
+
+//HD44780 bus, write a command (rs = 0) or data (rs = 1) byte, read the status
+//register (busy flag in bit 7)
+void HAL_lcd_write(unsigned char rs, unsigned char byte);
+unsigned char HAL_lcd_status(void);
+
+//busy wait delays, only used during the LCD power on sequence
+void HAL_delay_us(unsigned int us);
+void HAL_delay_ms(unsigned int ms);
+
+//UART, the transmitter takes bytes from UART_tx_next() while it is started,
+//received bytes are passed to UART_rx_byte()
+void HAL_uart_init(long baudrate);
+void HAL_uart_tx_start(void);
+void HAL_uart_tx_stop(void);
+unsigned char HAL_uart_tx_done(void);
+
+//driver enable of the RS-485 transceiver of the multi-door bus (bus.h), on
+//only while a door sends its reply
+void HAL_bus_drive(unsigned char on);
+
+//EEPROM, the ready interrupt calls EEPROM_isr() while it is enabled and no
+//write is in progress
+unsigned char HAL_eeprom_busy(void);
+unsigned char HAL_eeprom_read(unsigned int addr);
+void HAL_eeprom_write(unsigned int addr, unsigned char data);
+void HAL_eeprom_irq(unsigned char on);
+
+//1 ms system tick, calls TICK_isr() every millisecond, HAL_tick_elapsed()
+//returns the microseconds since the last tick, 1000 or more if a tick is due
+//but not served yet
+void HAL_tick_init(void);
+unsigned int HAL_tick_elapsed(void);
+
+//free running CPU cycle count for the benchmark probes, only differences are
+//meaningful, on the ATmega it is derived from Timer1 (8 cycle resolution)
+unsigned long HAL_cycles(void);
+
+//memory budget in bytes, static RAM (data and bss), RAM left between the bss
+//and the stack pointer, size of the flash image, the host backend reports 0
+void HAL_memory(unsigned int* ram, unsigned int* stack, unsigned int* flash);
+
+//driver entry points called by the backend
+void TICK_isr(void);
+int UART_tx_next(void);
+void UART_rx_byte(unsigned char c);
+void EEPROM_isr(void);
+void SLEEP_isr(void);
+
+#endif
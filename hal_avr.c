@@ -0,0 +1,278 @@
+//included libraries
+#include "config.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/delay.h>
+#include <avr/sleep.h>
+#include "hal.h"
+#include "tick.h"
+
+//ATmega backend of the hardware abstraction layer
+
+void HAL_init(void){
+	
+	//HAL_init() declares all PORTs as out/in and set the initial value into PORTs
+	//PORTA -> LCD DATA PORT which send 8bit frame data or command to LCD screen
+	//PORTB -> MATRIX PORT which controls 4x4 keypad rows and columns
+	//PORTC -> OUTPUT PORT which controls buzzer and relay state
+	//PORTD -> LCD_CONTROL PORT which controls communication with LCD (EN, RS and RW)
+	
+	DATA_DDR = 0xFF; //declare LCD data PORT as output
+	LCD_DATA = 0x00; //initialise PORTA as hex 0x00
+	MATRIX_DDR = 0x0F; //initially DDRB, MATRIX_DDR is declared as hex 0x0F,
+	//matrix columns are connected to PORT pins PB0 - PB3, rows to PB4 - PB7
+	//columns are initially at HIGH state, rows at LOW state
+	MATRIX_DATA = 0x00;//PORTB initial value 0x00
+	OUT_DDR = 0xFF; //PORTC declared as output
+	OUT_PORT = 0x00; //initial value 0x00
+	CONTROL_DDR = 0xFF; //declare LCD command PORT as output
+	PORTD = 0x00; //initial PORTD value 0x00
+#if SLEEP_MODE == 2
+	CONTROL_DDR &= ~(1 << PD2); //INT0, keypad columns and RXD through diodes
+#endif
+}
+
+void HAL_irq_enable(void){
+	SREG |= 0x80; //write hex 0x80 into SREG, enabling  I bit which causses enabling
+	//global interrupt, also it cane be written as SREG |= (1 << I);
+}
+
+void HAL_irq_disable(void){
+	SREG &= ~0x80; //clear the I bit, no interrupt until HAL_irq_enable()
+}
+
+void HAL_sleep(unsigned char mode){
+	
+	//HAL_sleep() is called with interrupts disabled, SEI enables them only
+	//after the next instruction, so an interrupt which became pending after
+	//the caller's check wakes the CPU right after the SLEEP instruction and
+	//is never missed
+	//for power-down the matrix is turned around, the rows PB4 - PB7 are
+	//driven low and the columns PB0 - PB3 are inputs with pull-ups, a pressed
+	//key pulls its column low, the columns and RXD (PD0, low during a start
+	//bit) are diode-ORed onto INT0 (PD2, pull-up on), INT0 wakes from
+	//power-down on a low level only
+	
+	unsigned char columns = MATRIX_DATA;
+	if(mode == HAL_SLEEP_DOWN){
+		MATRIX_DDR = 0xF0; //rows output, columns input
+		MATRIX_DATA = 0x0F; //rows low, column pull-ups
+		PORTD |= (1 << PD2); //INT0 pull-up
+		MCUCR &= ~((1 << ISC01) | (1 << ISC00)); //INT0 on low level
+		GIFR = (1 << INTF0);
+		GICR |= (1 << INT0);
+		set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+	}
+	else{
+		set_sleep_mode(SLEEP_MODE_IDLE);
+	}
+	sleep_enable();
+	sei();
+	sleep_cpu(); //woken by an interrupt, its handler ran
+	sleep_disable();
+	if(mode == HAL_SLEEP_DOWN){
+		GICR &= ~(1 << INT0);
+		PORTD &= ~(1 << PD2); //no current through the diodes while scanning
+		MATRIX_DATA = columns; //scanned column again
+		MATRIX_DDR = 0x0F; //columns output, rows input
+	}
+}
+
+void HAL_out_set(unsigned char mask){
+	HAL_ATOMIC{
+		OUT_PORT |= mask;
+	}
+}
+
+void HAL_out_clear(unsigned char mask){
+	HAL_ATOMIC{
+		OUT_PORT &= ~mask;
+	}
+}
+
+unsigned char HAL_out_get(void){
+	return OUT_PORT;
+}
+
+void HAL_matrix_column(unsigned char column){
+	MATRIX_DATA &= 0xF0; //disable all columns without disturbing remaining pins
+	MATRIX_DATA |= (1 << column); //enable particular column
+}
+
+unsigned char HAL_matrix_rows(void){
+	return PINB >> 4; //rows are connected to PB4 - PB7
+}
+
+void HAL_lcd_write(unsigned char rs, unsigned char byte){
+	//one write cycle on the LCD bus, the controller latches the byte on the
+	//falling edge of EN, the execution time (~40 us) is covered by the caller
+	LCD_DATA = byte;
+	if(rs){
+		LCD_CONTROL |= (1 << RS); //RS set, byte goes to the data register
+	}
+	else{
+		LCD_CONTROL &= ~(1 << RS); //RS cleared, byte goes to the command register
+	}
+	LCD_CONTROL &= ~(1 << RW); //write operation
+	LCD_CONTROL |= (1 << EN); //enable pulse
+	_delay_us(1); //EN pulse width, at least 450 ns
+	LCD_CONTROL &= ~(1 << EN);
+}
+
+unsigned char HAL_lcd_status(void){
+	//read the status register, PORTA is switched to input for the read cycle
+	//(RS cleared, RW set) and back to output after it
+	unsigned char status;
+	DATA_DDR = 0x00; //LCD data PORT as input
+	LCD_DATA = 0x00; //no pull-ups
+	LCD_CONTROL &= ~(1 << RS); //status register
+	LCD_CONTROL |= (1 << RW); //read operation
+	LCD_CONTROL |= (1 << EN);
+	_delay_us(1); //data output delay, at most 360 ns
+	status = PINA;
+	LCD_CONTROL &= ~(1 << EN);
+	LCD_CONTROL &= ~(1 << RW);
+	DATA_DDR = 0xFF; //LCD data PORT as output again
+	return status;
+}
+
+void HAL_delay_us(unsigned int us){
+	while(us--){
+		_delay_us(1);
+	}
+}
+
+void HAL_delay_ms(unsigned int ms){
+	while(ms--){
+		_delay_ms(1);
+	}
+}
+
+void HAL_uart_init(long UART_BAUDRATE){
+	UCSRB |= (1 << RXEN) | (1 << TXEN) | (1 << RXCIE);
+	//enabling transreceiving and enabling interrupt on the RXC flag in UCSRA
+	UCSRC |= (1 << URSEL) | (1 << UCSZ0) | (1 << UCSZ1); //enabling URSEL enablae 
+	//frame bit changing, UCSZ0 and UCSZ1 set declare 8bit frame UART communication
+	UBRRL = BAUD_PRESCALE; //setting lower UART baud rate reg
+	UBRRH = (BAUD_PRESCALE >> 8); //setting upper UART baud rate reg
+}
+
+void HAL_bus_drive(unsigned char on){
+	if(on){
+		LCD_CONTROL |= (1 << BUS_DE); //transceiver drives the line
+	}
+	else{
+		LCD_CONTROL &= ~(1 << BUS_DE); //line is free, receiver stays on
+	}
+}
+
+void HAL_uart_tx_start(void){
+	UCSRA |= (1 << TXC); //clear TXC, it is set again when the ring is empty
+	//and the last frame is shifted out
+	UCSRB |= (1 << UDRIE); //enable data register empty interrupt
+}
+
+void HAL_uart_tx_stop(void){
+	UCSRB &= ~(1 << UDRIE);
+}
+
+unsigned char HAL_uart_tx_done(void){
+	return (UCSRA & (1 << TXC)) != 0; //last frame shifted out
+}
+
+unsigned char HAL_eeprom_busy(void){
+	return (EECR & (1 << EEWE)) || (SPMCR & (1 << SPMEN));
+}
+
+unsigned char HAL_eeprom_read(unsigned int addr){
+	//caller makes sure no write is in progress
+	//set the address where data is stored in EEPROM memory
+	EEARH = addr / 256;
+	EEARL = addr % 256;
+	EECR |= (1 << EERE); //write 1 to EERE to enable read operation from add
+	return EEDR; //read EEDR reg
+}
+
+void HAL_eeprom_write(unsigned int addr, unsigned char data){
+	//start a write cycle, caller makes sure no write is in progress
+	//set an address into lower and upper EEPROM address reg
+	EEARH = addr / 256; 
+	EEARL = addr % 256;
+	EEDR = data; //set the data into EEPROM data reg
+	HAL_ATOMIC{
+		//EEWE has to be set within 4 cycles after EEMWE, no interrupt in between
+		EECR |= (1 << EEMWE); //set the EEMWE bit
+		EECR |= (1 << EEWE); //set the EEWE bit and data will be written
+		//in the EEPROM memory at the EEAR address
+	}
+}
+
+void HAL_eeprom_irq(unsigned char on){
+	if(on){
+		EECR |= (1 << EERIE); //enable EEPROM ready interrupt
+	}
+	else{
+		EECR &= ~(1 << EERIE);
+	}
+}
+
+void HAL_tick_init(void){
+	//Timer1 is the 1 ms system tick, CTC mode (WGM12) with clk/8 prescale
+	//(CS11), so TCNT1 counts microseconds
+	OCR1A = TICK_OCR1A;
+	TCCR1A = 0x00;
+	TCCR1B = (1 << WGM12) | (1 << CS11);
+	TIMSK |= (1 << OCIE1A); //enable Timer1 output compare match interrupt
+}
+
+unsigned int HAL_tick_elapsed(void){
+	//called with interrupts disabled, a compare match which is pending is
+	//counted as a whole tick
+	unsigned int count = TCNT1;
+	if((TIFR & (1 << OCF1A)) && count < TICK_OCR1A){
+		count += TICK_OCR1A + 1; //counter already restarted
+	}
+	return count;
+}
+
+unsigned long HAL_cycles(void){
+	return TICK_us() * (F_CPU / 1000000UL); //Timer1 counts every 8 cycles
+}
+
+void HAL_memory(unsigned int* ram, unsigned int* stack, unsigned int* flash){
+	//section boundaries of the avr-libc linker script
+	extern char __data_start, __bss_end, __data_load_end;
+	*ram = (unsigned int)&__bss_end - (unsigned int)&__data_start;
+	*stack = SP - (unsigned int)&__bss_end;
+	*flash = (unsigned int)&__data_load_end;
+}
+
+ISR(TIMER1_COMPA_vect){
+	TICK_isr();
+}
+
+ISR(USART_UDRE_vect){
+	//UDR is empty, send the next byte or stop the interrupt if ring is empty
+	int c = UART_tx_next();
+	if(c < 0){
+		UCSRB &= ~(1 << UDRIE);
+		return;
+	}
+	UDR = c;
+}
+
+ISR(USART_RXC_vect){
+	UART_rx_byte(UDR); //reading UDR clears RXC
+}
+
+ISR(INT0_vect){
+	//low level interrupt, it is disabled at once or it would be entered again
+	//as long as the key is held
+	GICR &= ~(1 << INT0);
+	SLEEP_isr();
+}
+
+ISR(EE_RDY_vect){
+	//EEPROM ready interrupt is active as long as EEWE is cleared
+	EEPROM_isr();
+}
@@ -0,0 +1,470 @@
+//included libraries
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "config.h"
+#include "bus.h"
+#include "frame.h"
+#include "audit.h"
+#include "cred.h"
+#include "keymap.h"
+#include "hal_host.h"
+#include "sim.h"
+
+//multi-door bus simulator, build with -DBUS_ADDRESS=1, door 1 is the lock
+//firmware in the simulator, doors 2 to N are virtual doors, the protocol
+//engine of the firmware (bus.h) with random events behind it, the controller
+//polls them in turn on one RS-485 line at BUS_BAUDRATE in virtual time, it
+//owns the modem and counts an alert per lockout event, door 1 is locked out
+//by three wrong PINs, the controller unblocks it and sets a new master PIN,
+//then the new PIN opens the door, noise corrupts the given bytes per million
+//on the line, after the run no event is generated and the controller drains
+//the queues, the report is one JSON object with the throughput of the line
+//and the latency from an event to its delivery at the controller
+//usage: bus_sim [doors] [seconds] [seed] [noise]
+
+#define DOORS_MAX 254
+#define EVENT_MS 20000 //mean time between the events of a virtual door
+#define LAT_BUCKETS 32
+#define LAT_BUCKET_MS 100 //the last bucket everything above
+#define CTL_GAP_MS 2 //controller waits after a reply, the door turns its driver off
+#define CTL_TIMEOUT_MS 10 //after the last byte of a poll
+#define CTL_COMMANDS 4 //queued commands per door
+#define LINE 256 //bytes on the line, power of 2
+
+//controller state of a door
+struct ctl_door{
+	unsigned char ack; //sequence sent in the next poll
+	unsigned char last; //sequence of the last event delivered
+	unsigned char cseq; //sequence of the command in the polls
+	unsigned char commands[CTL_COMMANDS][BUS_PAYLOAD];
+	unsigned char lens[CTL_COMMANDS];
+	unsigned char count; //queued commands, the first one is in the polls
+	unsigned long generated; //events of a virtual door
+	unsigned long delivered;
+};
+
+static unsigned long seed;
+static unsigned long noise; //bytes corrupted per million
+static unsigned int doors;
+static struct BUS_door virt[DOORS_MAX + 1]; //virtual doors 2 to doors
+static struct ctl_door ctl[DOORS_MAX + 1];
+
+//the line, bytes with their sender, one byte time is 10 bits
+static unsigned char line[LINE], line_from[LINE];
+static unsigned int line_head, line_tail;
+static unsigned long line_credit; //byte times x 1000 / BUS_BAUDRATE * 10
+static unsigned long bytes, busy_ms, collisions, undriven, corrupted;
+
+//controller
+static unsigned char polled; //door of the last poll
+static unsigned char waiting; //for its reply
+static unsigned long deadline, next_poll;
+static unsigned char rx[BUS_FRAME];
+static unsigned char rx_len;
+static unsigned long polls, replies, timeouts, crc_errors, lost_flags, alerts;
+static unsigned long round_start, round_max, rounds, round_total;
+static unsigned long lat[LAT_BUCKETS], lat_max, delivered;
+static unsigned long dropped; //events of a full queue of a virtual door
+
+//virtual door replying and when
+static unsigned char reply_door;
+static unsigned long reply_at;
+
+//door 1, firmware
+static unsigned long boot_at;
+static unsigned long lockout_at, unblock_at, unblock_by = 0xFF, pin_set_at;
+static unsigned char opened, entered;
+static char new_pin[PIN_LENGTH + 1];
+
+//key script of door 1, times of press and release
+static struct{
+	unsigned long at;
+	unsigned char key, pressed;
+} keys[256];
+static unsigned int key_count, key_next;
+
+static unsigned long sim_random(unsigned long n){
+	//xorshift32, 0 to n - 1
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	seed &= 0xFFFFFFFFUL;
+	return seed % n;
+}
+
+static void line_send(unsigned char from, unsigned char c){
+	
+	//line_send() puts a byte of a node on the line, a byte of another node
+	//still on the line means two drivers are on
+	
+	unsigned int last = (line_head - 1) & (LINE - 1);
+	if(line_head != line_tail && line_from[last] != from){
+		collisions++;
+	}
+	line[line_head] = c;
+	line_from[line_head] = from;
+	line_head = (line_head + 1) & (LINE - 1);
+}
+
+static void firmware_tx(unsigned char c){
+	//byte of door 1 from the UART
+	if(!HOST_bus_drive){
+		undriven++; //the transceiver would not send it
+	}
+	line_send(1, c);
+}
+
+static void deliver(unsigned char door, unsigned char event, unsigned char user, unsigned long time){
+	
+	//deliver() is the controller getting a new event, time is the virtual ms
+	//it was logged at, a lockout costs an alert SMS, the lockout of door 1 is
+	//answered with an unblock and a new master PIN
+	
+	unsigned long ms = HOST_now - time, i;
+	lat[ms / LAT_BUCKET_MS < LAT_BUCKETS ? ms / LAT_BUCKET_MS : LAT_BUCKETS - 1]++;
+	if(ms > lat_max){
+		lat_max = ms;
+	}
+	delivered++;
+	ctl[door].delivered++;
+	if(event == AUDIT_LOCKOUT){
+		alerts++;
+	}
+	if(door != 1){
+		return;
+	}
+	if(event == AUDIT_LOCKOUT && ctl[1].count + 2 <= CTL_COMMANDS){
+		lockout_at = time;
+		ctl[1].commands[ctl[1].count][0] = BUS_UNBLOCK;
+		ctl[1].lens[ctl[1].count++] = 1;
+		ctl[1].commands[ctl[1].count][0] = BUS_PIN;
+		ctl[1].commands[ctl[1].count][1] = 0;
+		for(i = 0; i < PIN_LENGTH; i++){
+			new_pin[i] = '0' + (9 - i % 10);
+			ctl[1].commands[ctl[1].count][2 + i] = 9 - i % 10;
+		}
+		new_pin[PIN_LENGTH] = '\0';
+		ctl[1].lens[ctl[1].count++] = 2 + PIN_LENGTH;
+	}
+	else if(event == AUDIT_UNBLOCK){
+		unblock_at = time;
+		unblock_by = user;
+	}
+	else if(event == AUDIT_USER_SET){
+		pin_set_at = time;
+	}
+	else if(event == AUDIT_OPEN){
+		opened = 1;
+	}
+}
+
+static void reply(const unsigned char* p, unsigned char len){
+	
+	//reply() takes the reply of the polled door, after a boot the controller
+	//acknowledges nothing once and forgets the sequences of the door, a
+	//delivered event is acknowledged in the next poll, the command in the
+	//polls is done when the door reports its sequence
+	
+	struct ctl_door* c = &ctl[polled];
+	unsigned long time;
+	unsigned char i;
+	if(len < 3 || p[0] != polled){
+		return;
+	}
+	replies++;
+	waiting = 0;
+	next_poll = HOST_now + CTL_GAP_MS;
+	if(p[1] & BUS_BOOT){
+		c->ack = 0;
+		c->last = 0;
+	}
+	if(p[1] & BUS_LOST){
+		lost_flags++;
+	}
+	if(c->count != 0 && p[2] == c->cseq){
+		c->count--; //command executed, the next one goes out
+		for(i = 0; i < c->count; i++){
+			memcpy(c->commands[i], c->commands[i + 1], BUS_PAYLOAD);
+			c->lens[i] = c->lens[i + 1];
+		}
+		if(c->count != 0 && ++c->cseq == 0){
+			c->cseq = 1;
+		}
+	}
+	if(len >= 10){
+		time = p[6] | (unsigned long)p[7] << 8 | (unsigned long)p[8] << 16 | (unsigned long)p[9] << 24;
+		if(polled == 1){
+			time += boot_at; //tick of the firmware
+		}
+		if(p[3] != c->last){
+			deliver(polled, p[4], p[5], time);
+		}
+		c->last = p[3];
+		if(!(p[1] & BUS_BOOT)){
+			c->ack = p[3];
+		}
+	}
+	if(!(p[1] & BUS_MORE)){
+		if(polled == doors){
+			rounds++;
+			round_total += HOST_now - round_start;
+			if(HOST_now - round_start > round_max){
+				round_max = HOST_now - round_start;
+			}
+			round_start = HOST_now;
+		}
+		polled = polled == doors ? 1 : polled + 1;
+	}
+}
+
+static void controller_rx(unsigned char b){
+	//frame parser of the controller, only replies are taken
+	unsigned char crc, i, len;
+	if(rx_len == 0){
+		rx_len = b == FRAME_SYNC;
+		return;
+	}
+	rx[rx_len - 1] = b;
+	rx_len++;
+	if(rx_len == 4 && (rx[1] > BUS_PAYLOAD || rx[2] != 0)){
+		rx_len = 0;
+		return;
+	}
+	if(rx_len < 4 || rx_len < rx[1] + 5){
+		return;
+	}
+	rx_len = 0;
+	len = rx[1];
+	for(crc = 0, i = 0; i < len + 3; i++){
+		crc = FRAME_crc8(crc, rx[i]);
+	}
+	if(crc != rx[len + 3]){
+		crc_errors++;
+		return;
+	}
+	if(rx[0] == FRAME_REPLY && waiting){
+		reply(rx + 3, len);
+	}
+}
+
+static void controller(void){
+	
+	//controller() sends the next poll when the line is free, a poll without
+	//a reply in CTL_TIMEOUT_MS after its last byte moves on to the next door
+	
+	unsigned char payload[BUS_PAYLOAD], frame[BUS_FRAME], len = 2, n, i;
+	struct ctl_door* c;
+	if(waiting){
+		if(line_head == line_tail && (long)(HOST_now - deadline) >= 0){
+			timeouts++;
+			waiting = 0;
+			rx_len = 0;
+			polled = polled == doors ? 1 : polled + 1;
+			next_poll = HOST_now;
+		}
+		return;
+	}
+	if((long)(HOST_now - next_poll) < 0 || line_head != line_tail){
+		return;
+	}
+	c = &ctl[polled];
+	payload[0] = polled;
+	payload[1] = c->ack;
+	if(c->count != 0){
+		if(c->cseq == 0){
+			c->cseq = 1;
+		}
+		payload[2] = c->cseq;
+		memcpy(payload + 3, c->commands[0], c->lens[0]);
+		len = 3 + c->lens[0];
+	}
+	n = BUS_frame(frame, FRAME_POLL, payload, len);
+	for(i = 0; i < n; i++){
+		line_send(0, frame[i]);
+	}
+	polls++;
+	waiting = 1;
+	deadline = HOST_now + (n * 10000UL + BUS_BAUDRATE - 1) / BUS_BAUDRATE + CTL_TIMEOUT_MS;
+}
+
+static void line_run(void){
+	
+	//line_run() moves the bytes which fit one millisecond to every other
+	//node, a virtual door answers a poll a millisecond later, the firmware
+	//when its main loop runs
+	
+	unsigned char c, from;
+	unsigned int d;
+	line_credit += BUS_BAUDRATE / 10;
+	if(line_head == line_tail){
+		if(line_credit > 1000){
+			line_credit = 1000; //an idle line does not save byte times
+		}
+		return;
+	}
+	busy_ms++;
+	while(line_head != line_tail && line_credit >= 1000){
+		line_credit -= 1000;
+		c = line[line_tail];
+		from = line_from[line_tail];
+		line_tail = (line_tail + 1) & (LINE - 1);
+		bytes++;
+		if(noise && sim_random(1000000) < noise){
+			c ^= 1 << sim_random(8);
+			corrupted++;
+		}
+		if(from != 0){
+			controller_rx(c);
+		}
+		if(from != 1){
+			HOST_uart_rx(c);
+		}
+		for(d = 2; d <= doors; d++){
+			if(d != from && BUS_door_rx(&virt[d], c)){
+				reply_door = d;
+				reply_at = HOST_now + 1;
+			}
+		}
+	}
+}
+
+static void virtual_doors(unsigned char events){
+	//reply due, events of the virtual doors
+	unsigned int d, i, n;
+	if(reply_door != 0 && (long)(HOST_now - reply_at) >= 0){
+		for(i = 0; i < virt[reply_door].tx_len; i++){
+			line_send(reply_door, virt[reply_door].tx[i]);
+		}
+		reply_door = 0;
+	}
+	for(d = 2; events && d <= doors; d++){
+		if(sim_random(EVENT_MS) != 0){
+			continue;
+		}
+		n = sim_random(100);
+		dropped += virt[d].count + (n < 80 ? 1 : 3) > BUS_EVENTS ? virt[d].count + (n < 80 ? 1 : 3) - BUS_EVENTS : 0;
+		if(n < 80){
+			BUS_door_event(&virt[d], n & 1 ? AUDIT_OPEN : AUDIT_CLOSE, sim_random(CRED_USERS), HOST_now);
+			ctl[d].generated++;
+		}
+		else{
+			//three strikes at once, a burst for the queue
+			for(i = 0; i < 3; i++){
+				BUS_door_event(&virt[d], i == 2 ? AUDIT_LOCKOUT : AUDIT_WRONG, CRED_NONE, HOST_now);
+				ctl[d].generated++;
+			}
+		}
+	}
+}
+
+static void script_key(unsigned long* at, unsigned char key){
+	keys[key_count].at = *at;
+	keys[key_count].key = key;
+	keys[key_count++].pressed = 1;
+	keys[key_count].at = *at + 20;
+	keys[key_count].key = key;
+	keys[key_count++].pressed = 0;
+	*at += 40;
+}
+
+static void script_pin(unsigned long at, const char* digits){
+	//reset key, digits, open/close key
+	script_key(&at, SIM_key(KEY_RESET));
+	while(*digits){
+		script_key(&at, SIM_key(*digits++ - '0'));
+	}
+	script_key(&at, SIM_key(KEY_OPEN));
+}
+
+static void json_hist(const unsigned long* hist, unsigned char n){
+	unsigned char i;
+	printf("[");
+	for(i = 0; i < n; i++){
+		printf("%s%lu", i ? "," : "", hist[i]);
+	}
+	printf("]");
+}
+
+int main(int argc, char** argv){
+	unsigned long seconds, end, generated = 0, i;
+	struct timespec a, b;
+	double wall;
+	doors = argc > 1 ? strtoul(argv[1], 0, 10) : 250;
+	seconds = argc > 2 ? strtoul(argv[2], 0, 10) : 60;
+	seed = argc > 3 ? strtoul(argv[3], 0, 10) : 1;
+	noise = argc > 4 ? strtoul(argv[4], 0, 10) : 0;
+	if(doors < 1 || doors > DOORS_MAX || seconds < 30){
+		fprintf(stderr, "usage: bus_sim [doors 1 - %d] [seconds, 30 or more] [seed] [noise]\n", DOORS_MAX);
+		return 2;
+	}
+	if(seed == 0){
+		seed = 1;
+	}
+	HOST_reset();
+	SIM_erase();
+	for(i = 2; i <= doors; i++){
+		BUS_door_init(&virt[i], i, 0);
+		BUS_door_event(&virt[i], AUDIT_BOOT, CRED_NONE, HOST_now);
+		ctl[i].generated++;
+	}
+	//door 1: three wrong PINs from 2 s, the new PIN after the controller set it
+	for(i = 0; i < 3; i++){
+		script_pin(2000 + i * 2500, SIM_wrong);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &a);
+	boot_at = HOST_now;
+	SIM_boot();
+	HOST_uart_tx = firmware_tx; //the UART is the RS-485 line
+	polled = 1;
+	round_start = HOST_now;
+	end = HOST_now + seconds * 1000;
+	while((long)(HOST_now - end) < 30000){
+		if((long)(HOST_now - end) >= 0){
+			//drain, every generated event delivered
+			for(generated = 0, i = 2; i <= doors; i++){
+				generated += ctl[i].generated;
+			}
+			if(delivered - ctl[1].delivered + dropped >= generated && ctl[1].count == 0){
+				break;
+			}
+		}
+		if(pin_set_at != 0 && key_next == key_count && !entered){
+			script_pin(HOST_now + 1000, new_pin); //opens the door with the PIN of the controller
+			entered = 1;
+		}
+		while(key_next < key_count && keys[key_next].at <= HOST_now){
+			HOST_key(keys[key_next].key, keys[key_next].pressed);
+			key_next++;
+		}
+		virtual_doors((long)(HOST_now - end) < 0);
+		controller();
+		line_run();
+		SIM_run(1);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &b);
+	wall = (b.tv_sec - a.tv_sec) + (b.tv_nsec - a.tv_nsec) / 1e9;
+	for(generated = 0, i = 2; i <= doors; i++){
+		generated += ctl[i].generated;
+	}
+	printf("{\n\"doors\":%u,\"seconds\":%lu,\"seed\":%s,\"noise_ppm\":%lu,\"baudrate\":%d,"
+		"\"virtual_ms\":%lu,\"wall_s\":%.6f,\n",
+		doors, seconds, argc > 3 ? argv[3] : "1", noise, BUS_BAUDRATE, HOST_now - boot_at, wall);
+	printf("\"line\":{\"bytes\":%lu,\"busy_ms\":%lu,\"utilization\":%.3f,\"collisions\":%lu,"
+		"\"undriven\":%lu,\"corrupted\":%lu},\n",
+		bytes, busy_ms, (double)bytes * 10000 / BUS_BAUDRATE / (HOST_now - boot_at), collisions, undriven, corrupted);
+	printf("\"polls\":{\"sent\":%lu,\"replies\":%lu,\"timeouts\":%lu,\"crc_errors\":%lu,\"per_s\":%.1f,"
+		"\"rounds\":%lu,\"round_mean_ms\":%.1f,\"round_max_ms\":%lu},\n",
+		polls, replies, timeouts, crc_errors, polls * 1000.0 / (HOST_now - boot_at),
+		rounds, rounds ? (double)round_total / rounds : 0.0, round_max);
+	printf("\"events\":{\"generated\":%lu,\"delivered\":%lu,\"dropped\":%lu,\"lost_flags\":%lu,\"per_s\":%.1f,"
+		"\"alerts\":%lu,\"latency_max_ms\":%lu,\"latency_bucket_ms\":%d,\"latency\":",
+		generated + ctl[1].delivered, delivered, dropped, lost_flags, delivered * 1000.0 / (HOST_now - boot_at),
+		alerts, lat_max, LAT_BUCKET_MS);
+	json_hist(lat, LAT_BUCKETS);
+	printf("},\n\"door1\":{\"lockout_ms\":%lu,\"unblock_ms\":%lu,\"unblocked_by\":%lu,\"pin_set_ms\":%lu,"
+		"\"opened\":%u}\n}\n",
+		lockout_at - boot_at, unblock_at - boot_at, unblock_by, pin_set_at - boot_at, opened);
+	return 0;
+}
@@ -0,0 +1,230 @@
+//included libraries
+#include <stdio.h>
+#include <stdlib.h>
+#include "config.h"
+#include "frame.h"
+#include "telem.h"
+#include "audit.h"
+#include "bus.h"
+#include "trace.h"
+
+//decoder of the binary frames (frame.h) in a capture of the service port,
+//telemetry (telem.h), the audit log (audit.h), the input trace and the
+//EEPROM image (trace.h), or of the multi-door bus, polls and replies (bus.h),
+//text between the frames (AT commands, #BOOT lines) is skipped, frames with a
+//wrong CRC are reported and skipped
+//usage: frame_decode < capture
+
+static const char* const channels[] = {
+	"scan_us", "dispatch_us", "lcd_us", "eeprom_us", "commit_ms", "uart_us", "lockout_s", "sms_ms"
+};
+
+static const char* const waits[] = {"data", "command", "clear"};
+static const char* const signals[] = {"key", "timer", "rx"};
+
+static const char* const events[] = {
+	"boot", "open", "close", "wrong_pin", "lockout", "unblock",
+	"pin_change", "user_set", "user_off", "user_on", "sms_denied", "alert_lost"
+};
+
+static unsigned char crc8(unsigned char crc, unsigned char b){
+	unsigned char bit;
+	crc ^= b;
+	for(bit = 0; bit < 8; bit++){
+		crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+	}
+	return crc;
+}
+
+static unsigned long le(const unsigned char* p, unsigned char n){
+	unsigned long v = 0;
+	while(n--){
+		v = (v << 8) | p[n];
+	}
+	return v;
+}
+
+static void telem(const unsigned char* p, unsigned int len){
+	unsigned int i, n, count;
+	unsigned long handled;
+	const unsigned char* end = p + len;
+	if(len < 9 || len < 9 + p[8] * 10U){
+		printf("telemetry frame too short\n");
+		return;
+	}
+	printf("telemetry uptime=%lums keys_dropped=%lu uart_lost=%lu\n", le(p, 4), le(p + 4, 2), le(p + 6, 2));
+	n = p[8];
+	for(i = 0, p += 9; i < n; i++, p += 10){
+		count = le(p, 2);
+		printf("  %-12s n=%-5u min=%-5lu mean=%-7.1f max=%lu\n",
+			i < sizeof(channels) / sizeof(channels[0]) ? channels[i] : "?", count,
+			le(p + 2, 2), count ? (double)le(p + 6, 4) / count : 0.0, le(p + 4, 2));
+	}
+	if(end - p < 9 || end - p < 9 + p[8] * 8){
+		return; //no LCD counters
+	}
+	printf("  lcd written=%lu sent=%lu\n", le(p, 4), le(p + 4, 4));
+	n = p[8];
+	for(i = 0, p += 9; i < n; i++, p += 8){
+		count = le(p, 2);
+		printf("  lcd_wait_%-7s n=%-5u mean=%-7.1f max=%lu us\n",
+			i < sizeof(waits) / sizeof(waits[0]) ? waits[i] : "?", count,
+			count ? (double)le(p + 4, 4) / count : 0.0, le(p + 2, 2));
+	}
+	if(end - p < 1 || end - p < 1 + p[0] * 10){
+		return; //no scheduler latencies
+	}
+	n = p[0];
+	for(i = 0, p += 1; i < n; i++, p += 10){
+		handled = le(p, 4);
+		printf("  latency_%-8s n=%-7lu mean=%-7.1f max=%lu us\n",
+			i < sizeof(signals) / sizeof(signals[0]) ? signals[i] : "?", handled,
+			handled ? (double)le(p + 4, 4) / handled : 0.0, le(p + 8, 2));
+	}
+	if(end - p >= 2){
+		printf("  journal writes=%lu\n", le(p, 2));
+	}
+}
+
+static void audit(const unsigned char* p, unsigned int len){
+	
+	//one line per record, the time is the tick of the boot the record was
+	//written in, a boot record starts the next part of the log
+	
+	unsigned int i, n;
+	if(len < 8){
+		printf("audit frame too short\n");
+		return;
+	}
+	n = le(p + 4, 2);
+	printf("audit uptime=%lums records=%u lost=%lu\n", le(p, 4), n, le(p + 6, 2));
+	for(i = 0, p += 8; i < n && 8 + (i + 1) * AUDIT_RECORD <= len; i++, p += AUDIT_RECORD){
+		printf("  %4u %10lums %-10s", i, le(p + 2, 4),
+			p[0] < sizeof(events) / sizeof(events[0]) ? events[p[0]] : "?");
+		if(p[1] != 0xFF){
+			printf(" user=%u", p[1]);
+		}
+		printf("\n");
+	}
+}
+
+static void poll(const unsigned char* p, unsigned int len){
+	if(len < 2){
+		printf("poll frame too short\n");
+		return;
+	}
+	printf("poll door=%u ack=%u", p[0], p[1]);
+	if(len >= 4){
+		printf(" command=%u seq=%u args=%u", p[3], p[2], len - 4);
+	}
+	printf("\n");
+}
+
+static void reply(const unsigned char* p, unsigned int len){
+	if(len < 3){
+		printf("reply frame too short\n");
+		return;
+	}
+	printf("reply door=%u%s%s%s command=%u", p[0], p[1] & BUS_BOOT ? " boot" : "",
+		p[1] & BUS_LOST ? " lost" : "", p[1] & BUS_MORE ? " more" : "", p[2]);
+	if(len >= 10){
+		printf(" event=%u %lums %s", p[3], le(p + 6, 4),
+			p[4] < sizeof(events) / sizeof(events[0]) ? events[p[4]] : "?");
+		if(p[5] != 0xFF){
+			printf(" user=%u", p[5]);
+		}
+	}
+	printf("\n");
+}
+
+static void trace(const unsigned char* p, unsigned int len){
+	
+	//one line per record with its time in ms since boot, the frame starts
+	//at the time of the newest record of the previous one
+	
+	static const char* const types[TRACE_TYPES] = {"key", "rx", "tx", "eeprom", "out", "lcd"};
+	static const unsigned char lengths[TRACE_TYPES] = {1, 1, 2, 4, 1, 2};
+	unsigned long time;
+	unsigned int i;
+	unsigned char type, delta;
+	if(len < 10){
+		printf("trace frame too short\n");
+		return;
+	}
+	time = le(p + 4, 4);
+	printf("trace uptime=%lums from=%lums dropped=%lu\n", le(p, 4), time, le(p + 8, 2));
+	for(i = 10; i < len; ){
+		type = p[i] >> 5;
+		delta = p[i] & 0x1F;
+		i++;
+		if(delta == TRACE_DELTA && i + 2 <= len){
+			time += le(p + i, 2);
+			i += 2;
+		}
+		else if(delta == TRACE_TIME && i + 4 <= len){
+			time = le(p + i, 4);
+			i += 4;
+		}
+		else{
+			time += delta;
+		}
+		if(type >= TRACE_TYPES || i + lengths[type] > len){
+			printf("  broken record\n");
+			return;
+		}
+		printf("  %10lums %-6s", time, types[type]);
+		switch(type){
+			case TRACE_KEY: printf(" column=%u rows=0x%X", p[i] >> 4, p[i] & 0x0F); break;
+			case TRACE_RX: printf(" 0x%02X", p[i]); break;
+			case TRACE_TX: printf(" bytes=%u crc=0x%02X", p[i], p[i + 1]); break;
+			case TRACE_EEPROM: printf(" addr=%lu 0x%02X->0x%02X", le(p + i, 2), p[i + 2], p[i + 3]); break;
+			case TRACE_OUT: printf(" 0x%02X", p[i]); break;
+			case TRACE_LCD: printf(" row=%u col=%u '%c'", p[i] / 16, p[i] % 16, p[i + 1] >= 0x20 && p[i + 1] < 0x7F ? p[i + 1] : '?'); break;
+		}
+		printf("\n");
+		i += lengths[type];
+	}
+}
+
+int main(void){
+	static unsigned char buf[65536 + 5];
+	unsigned int len, i;
+	unsigned char crc;
+	int c;
+	while((c = getchar()) != EOF){
+		if(c != FRAME_SYNC){
+			continue;
+		}
+		for(i = 0; i < 3 && (c = getchar()) != EOF; i++){
+			buf[i] = c; //type and length
+		}
+		if(i < 3){
+			break;
+		}
+		len = buf[1] | (buf[2] << 8);
+		for(i = 0; i <= len && (c = getchar()) != EOF; i++){
+			buf[3 + i] = c; //payload and CRC
+		}
+		if(i <= len){
+			printf("truncated frame\n");
+			break;
+		}
+		for(crc = 0, i = 0; i < 3 + len; i++){
+			crc = crc8(crc, buf[i]);
+		}
+		if(crc != buf[3 + len]){
+			printf("CRC error in frame type 0x%02X\n", buf[0]);
+			continue;
+		}
+		switch(buf[0]){
+			case FRAME_TELEM: telem(buf + 3, len); break;
+			case FRAME_AUDIT: audit(buf + 3, len); break;
+			case FRAME_POLL: poll(buf + 3, len); break;
+			case FRAME_REPLY: reply(buf + 3, len); break;
+			case FRAME_TRACE: trace(buf + 3, len); break;
+			case FRAME_EEPROM: printf("EEPROM image, %u bytes\n", len); break;
+			default: printf("frame type 0x%02X, %u bytes\n", buf[0], len); break;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,363 @@
+//included libraries
+#include <string.h>
+#include <time.h>
+#include "config.h"
+#include "hal.h"
+#include "hal_host.h"
+#include "tick.h"
+#include "eeprom.h"
+
+//host backend of the hardware abstraction layer, see hal_host.h
+
+unsigned char HOST_out;
+unsigned int HOST_keys;
+unsigned char HOST_eeprom[1024];
+unsigned long HOST_eeprom_writes;
+unsigned char HOST_lcd_on;
+unsigned long HOST_now;
+unsigned char HOST_eeprom_ms = 9; //8.5 ms on the ATmega32
+void (*HOST_uart_tx)(unsigned char c);
+void (*HOST_tick_hook)(void);
+unsigned char HOST_sleep;
+unsigned long HOST_ms_active, HOST_ms_idle, HOST_ms_down;
+unsigned char HOST_key_woke;
+unsigned long HOST_key_scan;
+unsigned char HOST_bus_drive;
+
+static unsigned char HOST_column; //driven keypad column
+static unsigned char HOST_ddram[0x68]; //HD44780 display data RAM
+static unsigned char HOST_ddram_addr; //address counter
+static unsigned char HOST_irq; //global interrupt enable
+static unsigned char HOST_tick_on; //Timer1 running
+static unsigned char HOST_uart_on, HOST_eeprom_on; //interrupt enable bits
+static unsigned char HOST_in_isr; //an emulated interrupt is running
+static unsigned char HOST_eeprom_left; //ms until the write cycle is finished
+static unsigned int HOST_eeprom_addr; //cell of the write cycle
+static unsigned char HOST_eeprom_data;
+static unsigned long HOST_key_at; //virtual time of the last press
+
+#define HOST_DOWN (HAL_SLEEP_DOWN + 1)
+
+static void HOST_serve(void){
+	
+	//HOST_serve() runs the interrupts which are pending, a real interrupt can
+	//not preempt itself, so the emulator does not enter a handler again while
+	//one is running, the handler is called again until it disables itself
+	
+	int c;
+	if(!HOST_irq || HOST_in_isr){
+		return;
+	}
+	HOST_in_isr = 1;
+	if(HOST_sleep != HOST_DOWN && (HOST_uart_on || (HOST_eeprom_on && HOST_eeprom_left == 0))){
+		HOST_sleep = 0; //interrupt wakes the CPU
+	}
+	while(HOST_uart_on){
+		c = UART_tx_next();
+		if(c < 0){
+			HOST_uart_on = 0;
+		}
+		else if(HOST_uart_tx){
+			HOST_uart_tx((unsigned char)c);
+		}
+	}
+	while(HOST_eeprom_on && HOST_eeprom_left == 0){
+		EEPROM_isr(); //starts the next write cycle or disables itself
+	}
+	HOST_in_isr = 0;
+}
+
+void HOST_reset(void){
+	HOST_out = 0;
+	HOST_keys = 0;
+	HOST_column = 0;
+	memset(HOST_ddram, ' ', sizeof(HOST_ddram));
+	HOST_ddram_addr = 0;
+	HOST_lcd_on = 0;
+	HOST_irq = 0;
+	HOST_tick_on = 0;
+	HOST_uart_on = 0;
+	HOST_eeprom_on = 0;
+	HOST_in_isr = 0;
+	HOST_eeprom_left = 0;
+	HOST_sleep = 0;
+	HOST_bus_drive = 0;
+}
+
+void HOST_power_cut(void){
+	//an interrupted write cycle leaves the cell erased
+	if(HOST_eeprom_left != 0){
+		HOST_eeprom[HOST_eeprom_addr] = 0xFF;
+	}
+	HOST_reset();
+}
+
+void HOST_tick(void){
+	HOST_now++;
+	if(HOST_sleep == HOST_DOWN){
+		HOST_ms_down++;
+	}
+	else if(HOST_sleep){
+		HOST_ms_idle++;
+	}
+	else{
+		HOST_ms_active++;
+	}
+	if(HOST_eeprom_left != 0 && --HOST_eeprom_left == 0){
+		HOST_eeprom[HOST_eeprom_addr] = HOST_eeprom_data; //write cycle finished
+		HOST_eeprom_writes++;
+	}
+	if(HOST_irq && HOST_tick_on && !HOST_in_isr && HOST_sleep != HOST_DOWN){
+		HOST_sleep = 0; //tick wakes the CPU from idle
+		HOST_in_isr = 1;
+		TICK_isr();
+		HOST_in_isr = 0;
+	}
+	HOST_serve();
+	if(HOST_tick_hook){
+		HOST_tick_hook();
+	}
+}
+
+void HOST_skip(unsigned long ms){
+	//the firmware does not see the skipped ticks, only its clock moves, in
+	//power-down Timer1 is stopped and not even the clock moves
+	HOST_now += ms;
+	if(HOST_sleep == HOST_DOWN){
+		HOST_ms_down += ms;
+		return;
+	}
+	if(HOST_sleep){
+		HOST_ms_idle += ms;
+	}
+	else{
+		HOST_ms_active += ms;
+	}
+	TICK_skip(ms);
+}
+
+unsigned char HOST_idle(void){
+	return HOST_eeprom_left == 0 && EEPROM_pending() == 0;
+}
+
+void HAL_spin(void){
+	//a busy wait of the main loop, one millisecond passes, interrupt handlers
+	//never wait
+	if(!HOST_in_isr){
+		HOST_tick();
+	}
+}
+
+void HOST_key(unsigned char key, unsigned char pressed){
+	if(pressed){
+		HOST_keys |= 1U << (key - 1);
+		HOST_key_at = HOST_now;
+		HOST_key_scan = 0;
+		HOST_key_woke = HOST_sleep == HOST_DOWN;
+		HOST_int0(); //the column of the key pulls INT0 low
+	}
+	else{
+		HOST_keys &= ~(1U << (key - 1));
+	}
+}
+
+void HOST_int0(void){
+	//INT0 is enabled only in power-down
+	if(HOST_sleep == HOST_DOWN && HOST_irq && !HOST_in_isr){
+		HOST_sleep = 0;
+		HOST_in_isr = 1;
+		SLEEP_isr();
+		HOST_in_isr = 0;
+	}
+}
+
+void HOST_uart_rx(unsigned char c){
+	//in power-down the USART has no clock, the start bit wakes the CPU
+	//through INT0 and the byte is lost
+	if(HOST_sleep == HOST_DOWN){
+		HOST_int0();
+		return;
+	}
+	if(HOST_irq && !HOST_in_isr){
+		HOST_sleep = 0;
+		HOST_in_isr = 1;
+		UART_rx_byte(c);
+		HOST_in_isr = 0;
+	}
+}
+
+void HOST_lcd_row(unsigned char row, char* text){
+	memcpy(text, &HOST_ddram[row ? 0x40 : 0x00], 16);
+	text[16] = '\0';
+}
+
+void HAL_init(void){
+	HOST_out = 0;
+	HOST_column = 0;
+}
+
+void HAL_irq_enable(void){
+	HOST_irq = 1;
+	HOST_serve();
+}
+
+void HAL_irq_disable(void){
+	HOST_irq = 0;
+}
+
+void HAL_sleep(unsigned char mode){
+	//asleep until an interrupt, a pending one wakes the CPU at once, INT0
+	//is level triggered, a key held when the CPU goes down wakes it too
+	HOST_sleep = mode + 1;
+	HOST_irq = 1;
+	HOST_serve();
+	if(HOST_keys != 0){
+		HOST_int0();
+	}
+}
+
+void HAL_out_set(unsigned char mask){
+	HOST_out |= mask;
+}
+
+void HAL_out_clear(unsigned char mask){
+	HOST_out &= ~mask;
+}
+
+unsigned char HAL_out_get(void){
+	return HOST_out;
+}
+
+void HAL_matrix_column(unsigned char column){
+	HOST_column = column;
+}
+
+unsigned char HAL_matrix_rows(void){
+	//key (row * 4 + column + 1) connects the driven column to its row
+	unsigned char row, rows = 0;
+	for(row = 0; row < 4; row++){
+		if(HOST_keys & (1U << (row * 4 + HOST_column))){
+			rows |= 1 << row;
+		}
+	}
+	if(rows != 0 && HOST_key_scan == 0 && HOST_keys != 0){
+		HOST_key_scan = HOST_now - HOST_key_at; //first scan of the pressed key
+	}
+	return rows;
+}
+
+void HAL_lcd_write(unsigned char rs, unsigned char byte){
+	
+	//HD44780 instruction subset used by the LCD driver: clear, home, display
+	//control and set DDRAM address, data bytes are written at the address
+	//counter which is incremented, lines are 0x00 - 0x27 and 0x40 - 0x67
+	
+	if(rs){
+		HOST_ddram[HOST_ddram_addr] = byte;
+		HOST_ddram_addr++;
+		if(HOST_ddram_addr == 0x28){
+			HOST_ddram_addr = 0x40;
+		}
+		else if(HOST_ddram_addr == 0x68){
+			HOST_ddram_addr = 0x00;
+		}
+	}
+	else if(byte & 0x80){
+		HOST_ddram_addr = byte & 0x7F;
+		if((HOST_ddram_addr & 0x3F) >= 0x28){
+			HOST_ddram_addr &= 0x40; //outside the line, start of the line
+		}
+	}
+	else if(byte == 0x01){
+		memset(HOST_ddram, ' ', sizeof(HOST_ddram));
+		HOST_ddram_addr = 0;
+	}
+	else if((byte & 0xFE) == 0x02){
+		HOST_ddram_addr = 0;
+	}
+	else if((byte & 0xF8) == 0x08){
+		HOST_lcd_on = (byte >> 2) & 1;
+	}
+}
+
+unsigned char HAL_lcd_status(void){
+	return HOST_ddram_addr; //never busy
+}
+
+void HAL_delay_us(unsigned int us){
+}
+
+void HAL_delay_ms(unsigned int ms){
+}
+
+void HAL_uart_init(long baudrate){
+	HOST_uart_on = 0;
+}
+
+void HAL_uart_tx_start(void){
+	HOST_uart_on = 1;
+	HOST_serve();
+}
+
+void HAL_uart_tx_stop(void){
+	HOST_uart_on = 0;
+}
+
+unsigned char HAL_uart_tx_done(void){
+	return !HOST_uart_on;
+}
+
+void HAL_bus_drive(unsigned char on){
+	HOST_bus_drive = on;
+}
+
+unsigned char HAL_eeprom_busy(void){
+	return HOST_eeprom_left != 0;
+}
+
+unsigned char HAL_eeprom_read(unsigned int addr){
+	return HOST_eeprom[addr & 0x3FF];
+}
+
+void HAL_eeprom_write(unsigned int addr, unsigned char data){
+	if(HOST_eeprom_ms == 0){
+		HOST_eeprom[addr & 0x3FF] = data;
+		HOST_eeprom_writes++;
+		return;
+	}
+	HOST_eeprom_addr = addr & 0x3FF;
+	HOST_eeprom_data = data;
+	HOST_eeprom_left = HOST_eeprom_ms;
+}
+
+void HAL_eeprom_irq(unsigned char on){
+	HOST_eeprom_on = on;
+	if(on){
+		HOST_serve();
+	}
+}
+
+void HAL_tick_init(void){
+	HOST_tick_on = 1;
+}
+
+unsigned int HAL_tick_elapsed(void){
+	return 0; //time between the ticks is not emulated
+}
+
+void HAL_memory(unsigned int* ram, unsigned int* stack, unsigned int* flash){
+	*ram = 0; //no meaning on the host
+	*stack = 0;
+	*flash = 0;
+}
+
+unsigned long HAL_cycles(void){
+	//time stamp counter of the host CPU, nanoseconds where there is none
+#if defined(__x86_64__) || defined(__i386__)
+	return (unsigned long)__builtin_ia32_rdtsc();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long)ts.tv_sec * 1000000000UL + ts.tv_nsec;
+#endif
+}
@@ -0,0 +1,50 @@
+#ifndef HAL_HOST_H
+#define HAL_HOST_H
+
+//host backend of the hardware abstraction layer
+//the peripherals are emulated in memory and run on a virtual clock which is
+//driven by the caller: HOST_tick() is one millisecond of Timer1, HOST_skip()
+//jumps over milliseconds in which nothing happens, the UART transmitter is
+//served right when it is started, an EEPROM write cycle takes
+//HOST_eeprom_ms ticks (0 finishes it at once), a busy wait of a driver lets
+//the virtual time pass (HAL_spin())
+//HAL_sleep() can not block, it marks the CPU as sleeping until the next
+//interrupt which may wake it, every virtual millisecond is counted as active,
+//idle or power-down by the state the tick finds the CPU in, in power-down the
+//tick and the UART receiver are stopped and only HOST_int0() wakes the CPU,
+//a key press and the start bit of a received byte pull INT0 low
+
+//emulated pins and memories
+extern unsigned char HOST_out; //output PORT, relay, buzzer and the state LEDs
+extern unsigned int HOST_keys; //pressed keys, bit (key - 1) set if pressed
+extern unsigned char HOST_eeprom[1024]; //EEPROM cells, kept over HOST_reset()
+extern unsigned long HOST_eeprom_writes; //write cycles since the start
+extern unsigned char HOST_lcd_on; //display on/off control bit
+extern unsigned long HOST_now; //virtual milliseconds since the first power on
+extern unsigned char HOST_eeprom_ms; //length of an EEPROM write cycle
+extern unsigned char HOST_sleep; //0 awake, else HAL_SLEEP_IDLE + 1 or HAL_SLEEP_DOWN + 1
+extern unsigned long HOST_ms_active, HOST_ms_idle, HOST_ms_down; //virtual ms per CPU state
+extern unsigned char HOST_key_woke; //last press woke the CPU from power-down
+extern unsigned long HOST_key_scan; //ms from the last press to its first scan, 0 before
+extern unsigned char HOST_bus_drive; //RS-485 driver enabled (bus.h)
+
+//transmitted UART bytes are passed to this hook, if it is set
+extern void (*HOST_uart_tx)(unsigned char c);
+
+//called at the end of every HOST_tick(), busy waits included, if it is set
+extern void (*HOST_tick_hook)(void);
+
+//firmware entry point, drivers and lock state are brought up
+void lock_init(void);
+
+void HOST_reset(void); //power on, RAM side of the emulator is cleared
+void HOST_tick(void); //one millisecond, runs the Timer1 interrupt
+void HOST_skip(unsigned long ms); //idle milliseconds, no interrupt runs
+unsigned char HOST_idle(void); //no EEPROM write in progress or queued
+void HOST_power_cut(void); //a write cycle in progress is lost, RAM is cleared
+void HOST_key(unsigned char key, unsigned char pressed); //key 1 to 16
+void HOST_int0(void); //INT0 low, wakes the CPU from power-down
+void HOST_uart_rx(unsigned char c); //byte received from the GSM module
+void HOST_lcd_row(unsigned char row, char* text); //16 visible characters
+
+#endif
@@ -0,0 +1,210 @@
+//included libraries
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "config.h"
+#include "hal.h"
+#include "bench.h"
+#include "hal_host.h"
+#include "sim.h"
+#include "keymap.h"
+
+//benchmark runner, build with -DBENCH=1, the lock firmware runs a seeded mix
+//of right and wrong PINs, door open/close, PIN changes and lockouts in the
+//simulator, the firmware probes (bench.h) count host CPU cycles of the hot
+//paths, the runner converts them to nanoseconds and measures the latency from
+//the physical key press to the LCD and the relay in virtual milliseconds, the
+//time the CPU spends active, in idle sleep and in power-down gives the mean
+//MCU current, the latency from a press to the first scan of the key is kept
+//apart for presses which woke the CPU from power-down, the report is one
+//JSON object on stdout, build with -DSLEEP_MODE=0, 1 or 2 to compare
+//usage: lock_bench [rounds] [seed]
+
+#define LAT_BUCKETS 32 //1 ms each, the last one everything above
+
+//typical ATmega32 supply current at 8 MHz and 5 V from the data sheet, mA,
+//MCU only, the LCD, the LEDs and the GSM module are not counted
+#define MA_ACTIVE 12.0
+#define MA_IDLE 5.5
+#define MA_DOWN 0.001
+
+static unsigned long seed;
+static unsigned long lat_lcd[LAT_BUCKETS], lat_relay[LAT_BUCKETS];
+static unsigned long wake_down[LAT_BUCKETS], wake_awake[LAT_BUCKETS], wake_missed;
+static char pin[PIN_LENGTH + 1];
+
+static unsigned long bench_random(unsigned long n){
+	//xorshift32, 0 to n - 1
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	seed &= 0xFFFFFFFFUL;
+	return seed % n;
+}
+
+static double ns_per_cycle(void){
+	//calibrate HAL_cycles() against the monotonic clock over 50 ms
+	struct timespec a, b;
+	unsigned long c0, c1;
+	double ns;
+	clock_gettime(CLOCK_MONOTONIC, &a);
+	c0 = HAL_cycles();
+	do{
+		clock_gettime(CLOCK_MONOTONIC, &b);
+		ns = (b.tv_sec - a.tv_sec) * 1e9 + (b.tv_nsec - a.tv_nsec);
+	}while(ns < 50e6);
+	c1 = HAL_cycles();
+	return ns / (double)(c1 - c0);
+}
+
+static void press(unsigned char key){
+	
+	//press() holds a key for 20 ms like SIM_press(), every millisecond the LCD
+	//and the relay are compared with their state before the press, the first
+	//change is the latency of the key, a key which was not scanned while it
+	//was held is missed
+	
+	char before[2][17], now[2][17];
+	unsigned char relay = SIM_led(0), lcd = 0, out = 0, t;
+	HOST_lcd_row(0, before[0]);
+	HOST_lcd_row(1, before[1]);
+	HOST_key(key, 1);
+	for(t = 1; t <= 20; t++){
+		SIM_run(1);
+		HOST_lcd_row(0, now[0]);
+		HOST_lcd_row(1, now[1]);
+		if(!lcd && memcmp(before, now, sizeof(now)) != 0){
+			lcd = 1;
+			lat_lcd[t < LAT_BUCKETS ? t : LAT_BUCKETS - 1]++;
+		}
+		if(!out && SIM_led(0) != relay){
+			out = 1;
+			lat_relay[t < LAT_BUCKETS ? t : LAT_BUCKETS - 1]++;
+		}
+	}
+	if(HOST_key_scan == 0){
+		wake_missed++;
+	}
+	else if(HOST_key_woke){
+		wake_down[HOST_key_scan < LAT_BUCKETS ? HOST_key_scan : LAT_BUCKETS - 1]++;
+	}
+	else{
+		wake_awake[HOST_key_scan < LAT_BUCKETS ? HOST_key_scan : LAT_BUCKETS - 1]++;
+	}
+	HOST_key(key, 0);
+	SIM_run(20);
+}
+
+static void enter(const char* digits){
+	//reset key, digits, open/close key
+	press(SIM_key(KEY_RESET));
+	while(*digits){
+		press(SIM_key(*digits++ - '0'));
+	}
+	press(SIM_key(KEY_OPEN));
+}
+
+static void round_mix(void){
+	
+	//round_mix() is one visit at the door: mostly the right PIN to open and
+	//close, sometimes a typo, a PIN change or three strikes
+	
+	char wrong[PIN_LENGTH + 1];
+	unsigned long r = bench_random(100), i;
+	if(r < 60){
+		enter(pin); //open
+		enter(pin); //close
+	}
+	else if(r < 85){
+		for(i = 0; i < PIN_LENGTH; i++){
+			wrong[i] = '0' + bench_random(10);
+		}
+		wrong[PIN_LENGTH] = '\0';
+		enter(wrong);
+		SIM_run(2500);
+	}
+	else if(r < 95){
+		enter(pin); //open, the PIN matches
+		press(SIM_key(KEY_CHANGE));
+		for(i = 0; i < PIN_LENGTH; i++){
+			pin[i] = '0' + bench_random(10);
+			press(SIM_key(pin[i] - '0'));
+		}
+		press(SIM_key(KEY_SET));
+		press(SIM_key(KEY_OPEN)); //close
+	}
+	else{
+		for(i = 0; i < 3; i++){
+			enter(SIM_wrong);
+			SIM_run(2500);
+		}
+		SIM_run(BLOCK_SECONDS * 1000UL + 1000); //lockout
+	}
+}
+
+static void json_hist(const unsigned long* hist, unsigned char n){
+	unsigned char i;
+	printf("[");
+	for(i = 0; i < n; i++){
+		printf("%s%lu", i ? "," : "", hist[i]);
+	}
+	printf("]");
+}
+
+int main(int argc, char** argv){
+	static const char* names[BENCH_PROBES] = {
+		"key", "verify", "eeprom", "sms", "key_lcd", "key_relay"
+	};
+	unsigned long rounds = argc > 1 ? strtoul(argv[1], 0, 10) : 1000, i, hist[BENCH_BUCKETS];
+	struct BENCH_stat stat;
+	struct timespec a, b;
+	double scale = ns_per_cycle(), wall, ms;
+	unsigned char p, k;
+	seed = argc > 2 ? strtoul(argv[2], 0, 10) : 1;
+	if(seed == 0){
+		seed = 1;
+	}
+	HOST_reset();
+	SIM_erase();
+	strcpy(pin, SIM_right);
+	clock_gettime(CLOCK_MONOTONIC, &a);
+	SIM_boot();
+	SIM_run(1000);
+	for(i = 0; i < rounds; i++){
+		round_mix();
+	}
+	clock_gettime(CLOCK_MONOTONIC, &b);
+	wall = (b.tv_sec - a.tv_sec) + (b.tv_nsec - a.tv_nsec) / 1e9;
+	printf("{\n\"rounds\":%lu,\"seed\":%s,\"virtual_ms\":%lu,\"wall_s\":%.6f,\"ns_per_cycle\":%.6f,\n",
+		rounds, argc > 2 ? argv[2] : "1", HOST_now, wall, scale);
+	printf("\"probes\":[\n");
+	for(p = 0; p < BENCH_PROBES; p++){
+		BENCH_get(p, &stat);
+		for(k = 0; k < BENCH_BUCKETS; k++){
+			hist[k] = stat.hist[k];
+		}
+		printf("{\"name\":\"%s\",\"n\":%lu,\"min_cycles\":%lu,\"mean_cycles\":%lu,\"max_cycles\":%lu,"
+			"\"mean_ns\":%.1f,\"hist_shift\":%d,\"hist\":",
+			names[p], stat.count, stat.count ? stat.min : 0, stat.count ? stat.total / stat.count : 0,
+			stat.max, stat.count ? stat.total * scale / stat.count : 0.0, BENCH_SHIFT);
+		json_hist(hist, BENCH_BUCKETS);
+		printf("}%s\n", p + 1 < BENCH_PROBES ? "," : "");
+	}
+	printf("],\n\"latency_ms\":{\"key_lcd\":");
+	json_hist(lat_lcd, LAT_BUCKETS);
+	printf(",\"key_relay\":");
+	json_hist(lat_relay, LAT_BUCKETS);
+	printf("},\n\"wake_ms\":{\"from_down\":");
+	json_hist(wake_down, LAT_BUCKETS);
+	printf(",\"awake\":");
+	json_hist(wake_awake, LAT_BUCKETS);
+	printf(",\"missed\":%lu},\n", wake_missed);
+	ms = HOST_ms_active + HOST_ms_idle + HOST_ms_down;
+	printf("\"power\":{\"sleep_mode\":%d,\"active_ms\":%lu,\"idle_ms\":%lu,\"down_ms\":%lu,"
+		"\"mean_ma\":%.3f,\"busy_loop_ma\":%.3f}\n}\n",
+		SLEEP_MODE, HOST_ms_active, HOST_ms_idle, HOST_ms_down,
+		ms > 0 ? (HOST_ms_active * MA_ACTIVE + HOST_ms_idle * MA_IDLE + HOST_ms_down * MA_DOWN) / ms : 0.0,
+		MA_ACTIVE);
+	return 0;
+}
@@ -0,0 +1,54 @@
+//included libraries
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "config.h"
+#include "hal_host.h"
+#include "sim.h"
+
+//host runner, the lock firmware runs in the simulator, one round is three
+//wrong PINs, the lockout, the right PIN and closing the door again, the runner
+//reports how many virtual milliseconds and key events per second the host
+//executes
+//usage: lock_host [rounds]
+
+int main(int argc, char** argv){
+	unsigned long rounds = argc > 1 ? strtoul(argv[1], 0, 10) : 100, i, events = 0;
+	char row[17];
+	clock_t start;
+	double seconds;
+	HOST_reset();
+	SIM_erase();
+	start = clock();
+	SIM_boot();
+	SIM_run(1000); //modem comes up
+	for(i = 0; i < rounds; i++){
+		SIM_pin(SIM_wrong);
+		SIM_run(2500); //wrong PIN alarm
+		SIM_pin(SIM_wrong);
+		SIM_run(2500);
+		SIM_pin(SIM_wrong); //lockout
+		SIM_run(BLOCK_SECONDS * 1000UL + 1000);
+		SIM_pin(SIM_right); //open
+		if(!SIM_led(0)){
+			printf("round %lu: relay not switched on\n", i);
+			return 1;
+		}
+		SIM_pin(SIM_right); //close
+		events += 5 * 6 * 2;
+	}
+	seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+	HOST_lcd_row(0, row);
+	printf("lcd      |%s|\n", row);
+	HOST_lcd_row(1, row);
+	printf("         |%s|\n", row);
+	printf("rounds   %lu\n", rounds);
+	printf("sms      %lu\n", SIM_modem.sms);
+	printf("eeprom   %lu writes\n", HOST_eeprom_writes);
+	printf("time     %lu ms virtual in %.3f s\n", HOST_now, seconds);
+	if(seconds > 0){
+		printf("rate     %.0f ms/s, %.0f key events/s\n", HOST_now / seconds, events / seconds);
+	}
+	return 0;
+}
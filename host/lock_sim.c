@@ -0,0 +1,554 @@
+//included libraries
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "config.h"
+#include "hal_host.h"
+#include "sim.h"
+#include "audit.h"
+#include "cred.h"
+#include "frame.h"
+#include "uart.h"
+#include "keymap.h"
+#include "gsm.h"
+
+//scenario runner of the lock simulator, every scenario starts from an erased
+//EEPROM with the PIN SIM_right and checks the outputs the user sees (relay, LEDs,
+//buzzer, LCD) and the messages the GSM module sent, random choices come from
+//a seeded generator, so a failing run is replayed with the same seed
+//build with -DBLOCK_SECONDS=3600 to replay the hour long lockout
+//usage: lock_sim [runs] [seed]
+
+#define LOCKOUT_MS (BLOCK_SECONDS * 1000UL)
+
+static unsigned long seed;
+static unsigned long failed;
+static const char* scenario;
+
+static unsigned long sim_random(unsigned long n){
+	//xorshift32, 0 to n - 1
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	seed &= 0xFFFFFFFFUL;
+	return seed % n;
+}
+
+static void check(int ok, const char* what){
+	if(!ok){
+		printf("FAIL %s: %s (t = %lu ms)\n", scenario, what, HOST_now);
+		failed++;
+	}
+}
+
+static void power_on(void){
+	SIM_erase();
+	memset(&SIM_modem, 0, sizeof(SIM_modem));
+	HOST_reset();
+	SIM_boot();
+}
+
+static void strike_out(void){
+	//three wrong PINs, each one after the alarm of the previous one
+	SIM_pin(SIM_wrong);
+	SIM_run(2500);
+	SIM_pin(SIM_wrong);
+	SIM_run(2500);
+	SIM_pin(SIM_wrong);
+}
+
+static void lockout(void){
+	
+	//lockout(), three strikes block the keypad for BLOCK_SECONDS with the
+	//blocked LED on and one SMS to the contact number, keys are ignored
+	//until the time is over, then the right PIN opens the door
+	
+	scenario = "lockout";
+	power_on();
+	SIM_run(1000);
+	strike_out();
+	check(SIM_led(BLOCKED) && SIM_led(1), "blocked LED and buzzer on");
+	SIM_run(4000);
+	check(SIM_modem.sms == 1, "one SMS sent");
+	check(strcmp(SIM_modem.number, "0998742925") == 0, "SMS to the contact number");
+	check(!SIM_led(1), "buzzer off after 3 seconds");
+	SIM_pin(SIM_right);
+	check(!SIM_led(0), "keys ignored while blocked");
+	SIM_run(LOCKOUT_MS - 6000);
+	check(SIM_led(BLOCKED), "still blocked before the time is over");
+	SIM_run(2000);
+	check(!SIM_led(BLOCKED) && SIM_led(READY), "ready again");
+	SIM_pin(SIM_right);
+	check(SIM_led(0), "right PIN opens the door");
+}
+
+static void open_close(void){
+	
+	//open_close(), the open/close key alone closes the door the PIN opened,
+	//it is no wrong PIN, after the close the entry is gone
+	
+	scenario = "open close";
+	power_on();
+	SIM_run(1000);
+	SIM_pin(SIM_right);
+	check(SIM_led(0), "right PIN opens the door");
+	SIM_run(1000);
+	SIM_press(SIM_key(KEY_OPEN));
+	check(!SIM_led(0), "open/close key closes the door");
+	check(!SIM_led(1) && !SIM_led(WAIT) && SIM_led(READY), "close is no wrong PIN");
+	SIM_run(1000);
+	SIM_press(SIM_key(KEY_OPEN));
+	check(!SIM_led(0) && SIM_led(WAIT), "entry cleared by the close");
+}
+
+static void power_cuts(void){
+	
+	//power_cuts(), the power is cut one to three times at random moments of
+	//the lockout and stays off for a random time, after every boot the lock
+	//has to be blocked again, the blocked time counts only while powered and
+	//may grow by the time since the last journal checkpoint per cut, it may
+	//never shrink
+	
+	unsigned long blocked = 0, start, cuts, i, at, limit;
+	scenario = "power cut";
+	power_on();
+	SIM_run(1000);
+	strike_out();
+	check(SIM_led(BLOCKED), "blocked");
+	cuts = 1 + sim_random(3);
+	for(i = 0; i < cuts; i++){
+		at = HOST_now + sim_random(LOCKOUT_MS / cuts);
+		while(SIM_led(BLOCKED) && HOST_now < at){
+			start = HOST_now;
+			SIM_run(at - HOST_now < 1000 ? at - HOST_now : 1000);
+			blocked += HOST_now - start;
+		}
+		if(!SIM_led(BLOCKED)){
+			break; //lockout already over
+		}
+		SIM_power_cut();
+		HOST_now += 1 + sim_random(60000); //power is off
+		SIM_boot();
+		SIM_run(1);
+		check(SIM_led(BLOCKED), "blocked again after the power cut");
+	}
+	while(SIM_led(BLOCKED) && blocked < 2 * LOCKOUT_MS + 120000UL){
+		start = HOST_now;
+		SIM_run(1000);
+		blocked += HOST_now - start;
+	}
+	limit = LOCKOUT_MS + cuts * (JOURNAL_CHECKPOINT + 1) * 1000UL + 1000;
+	check(blocked + 1000 >= LOCKOUT_MS, "lockout not shortened by power cuts");
+	check(blocked <= limit, "lockout grows at most one checkpoint per cut");
+	SIM_pin(SIM_right);
+	check(SIM_led(0), "right PIN opens the door");
+}
+
+static void slow_modem(void){
+	
+	//slow_modem(), the lockout happens while the GSM module is still starting,
+	//the alert is remembered and sent once the module answers
+	
+	scenario = "slow modem";
+	power_on();
+	SIM_modem.boot_ms = HOST_now + 10000 + sim_random(20000);
+	strike_out();
+	check(SIM_led(BLOCKED), "blocked before the modem is up");
+	check(SIM_modem.sms == 0, "no SMS before the modem is up");
+	SIM_run(35000);
+	check(SIM_modem.sms == 1, "pending SMS sent after the modem came up");
+}
+
+static void staff(void){
+	
+	//staff(), every staff slot gets a random PIN on the service port, each
+	//one opens and closes the door, a disabled user is refused until enabled
+	//again, the PINs are still there after a power cut
+	
+	static char pins[CRED_USERS][PIN_LENGTH + 1];
+	char line[32];
+	unsigned char user, other, i;
+	scenario = "staff";
+	power_on();
+	SIM_run(1000);
+	for(user = 1; user < CRED_USERS; user++){
+		do{
+			for(i = 0; i < PIN_LENGTH; i++){
+				pins[user][i] = '0' + sim_random(10);
+			}
+			pins[user][PIN_LENGTH] = '\0';
+			for(other = 0; other < user; other++){
+				if(strcmp(pins[user], other ? pins[other] : SIM_right) == 0){
+					break; //every PIN is different
+				}
+			}
+		}while(other < user);
+		snprintf(line, sizeof(line), "#USER %u %s", user, pins[user]);
+		SIM_service(line);
+		SIM_run(50);
+	}
+	SIM_run(1000); //EEPROM queue written
+	SIM_power_cut();
+	SIM_boot();
+	SIM_run(1000);
+	for(user = 1; user < CRED_USERS; user++){
+		SIM_pin(pins[user]);
+		check(SIM_led(0), "staff PIN opens the door");
+		SIM_pin(pins[user]);
+		check(!SIM_led(0), "staff PIN closes the door");
+	}
+	user = 1 + sim_random(CRED_USERS - 1);
+	snprintf(line, sizeof(line), "#USER %u OFF", user);
+	SIM_service(line);
+	SIM_run(50);
+	SIM_pin(pins[user]);
+	check(!SIM_led(0) && SIM_led(WAIT), "disabled user refused");
+	SIM_run(2500);
+	SIM_pin(SIM_right);
+	check(SIM_led(0), "master PIN still opens the door");
+	SIM_pin(SIM_right);
+	snprintf(line, sizeof(line), "#USER %u ON", user);
+	SIM_service(line);
+	SIM_run(50);
+	SIM_pin(pins[user]);
+	check(SIM_led(0), "enabled user opens the door again");
+}
+
+static unsigned int audit_dump(unsigned char* events){
+	
+	//audit_dump() asks for the audit frame on the service port, checks its
+	//CRC and returns the record count, the event codes go to events
+	
+	unsigned int i, len, count = 0;
+	unsigned char crc = 0, bit;
+	const unsigned char* f = 0;
+	SIM_uart_len = 0;
+	SIM_service("#AUDIT");
+	SIM_run(100);
+	for(i = 0; i + 1 < SIM_uart_len; i++){
+		if(SIM_uart[i] == FRAME_SYNC && SIM_uart[i + 1] == FRAME_AUDIT){
+			f = &SIM_uart[i + 1];
+			break;
+		}
+	}
+	if(f == 0 || i + 4 > SIM_uart_len){
+		check(0, "audit frame sent");
+		return 0;
+	}
+	len = f[1] | (f[2] << 8);
+	if(i + 5 + len > SIM_uart_len){
+		check(0, "whole audit frame sent");
+		return 0;
+	}
+	for(i = 0; i < 3 + len; i++){
+		crc ^= f[i];
+		for(bit = 0; bit < 8; bit++){
+			crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+		}
+	}
+	check(crc == f[3 + len], "audit frame CRC");
+	count = f[7] | (f[8] << 8);
+	check(len == 8 + count * AUDIT_RECORD, "audit frame length");
+	for(i = 0; i < count && 8 + (i + 1) * AUDIT_RECORD <= len; i++){
+		events[i] = f[11 + i * AUDIT_RECORD];
+	}
+	return count;
+}
+
+static void audit(void){
+	
+	//audit(), the access events survive a power cut in order, after more
+	//events than the ring holds only the newest AUDIT_RECORDS are left, a
+	//record torn by a power cut on the second lap is not read as the record
+	//of the previous lap in its slot
+	
+	static const unsigned char expect[] = {
+		AUDIT_BOOT, AUDIT_WRONG, AUDIT_OPEN, AUDIT_CLOSE,
+		AUDIT_WRONG, AUDIT_WRONG, AUDIT_LOCKOUT, AUDIT_UNBLOCK, AUDIT_BOOT
+	};
+	static unsigned char before[AUDIT_RECORDS * AUDIT_RECORD];
+	unsigned char events[256], event, who;
+	unsigned int count, i, visits;
+	unsigned long time;
+	scenario = "audit";
+	power_on();
+	SIM_run(1000);
+	SIM_pin(SIM_wrong);
+	SIM_run(2500);
+	SIM_pin(SIM_right);
+	SIM_pin(SIM_right);
+	strike_out();
+	SIM_run(LOCKOUT_MS + 1000);
+	SIM_power_cut();
+	SIM_boot();
+	SIM_run(1000);
+	count = audit_dump(events);
+	check(count == sizeof(expect) && memcmp(events, expect, sizeof(expect)) == 0, "events in order");
+	visits = AUDIT_RECORDS / 2 + 1 + sim_random(AUDIT_RECORDS);
+	for(i = 0; i < visits; i++){
+		SIM_pin(SIM_right);
+		SIM_pin(SIM_right);
+	}
+	SIM_run(1000);
+	SIM_power_cut();
+	SIM_boot();
+	SIM_run(1000);
+	count = audit_dump(events);
+	check(count == AUDIT_RECORDS, "full ring");
+	check(events[count - 1] == AUDIT_BOOT, "newest record last");
+	for(i = 0; i + 1 < count; i++){
+		if(events[i] != ((count - 1 - i) % 2 ? AUDIT_CLOSE : AUDIT_OPEN)){
+			check(0, "oldest records overwritten");
+			break;
+		}
+	}
+	SIM_run(1000);
+	memcpy(before, &HOST_eeprom[AUDIT_BASE], sizeof(before));
+	SIM_pin(SIM_wrong); //record without a user over an open or close record
+	for(i = 0; i < 1000; i++){
+		for(count = 1; count < sizeof(before); count += AUDIT_RECORD){
+			if(HOST_eeprom[AUDIT_BASE + count] != before[count]){
+				break; //user byte written
+			}
+		}
+		if(count < sizeof(before)){
+			break;
+		}
+		SIM_run(1);
+	}
+	check(i < 1000, "wrong PIN record written");
+	SIM_power_cut();
+	SIM_boot();
+	for(i = 0; AUDIT_newest(i, &event, &who, &time); i++){
+		if((event == AUDIT_OPEN || event == AUDIT_CLOSE) && who == CRED_NONE){
+			check(0, "torn record not read as an old one");
+			break;
+		}
+	}
+	SIM_run(1000);
+	count = audit_dump(events);
+	check(count == AUDIT_RECORDS && events[count - 1] == AUDIT_BOOT, "log goes on after the torn record");
+}
+
+static void command(const char* sender, const char* pin, const char* text){
+	//SMS to the lock, the answer has 1.5 s
+	char sms[64];
+	snprintf(sms, sizeof(sms), "%s %s", pin, text);
+	SIM_sms_in(sender, sms);
+	SIM_run(1500);
+}
+
+static void sms_commands(void){
+	
+	//sms_commands(), the contact number unblocks the door, asks for the
+	//status and the log and changes the master PIN by SMS, a wrong PIN or
+	//another sender changes nothing and gets no answer, message text never
+	//reaches the service port, a burst of messages during a lockout loses no
+	//received byte
+	
+	static const char contact[] = "+95998742925", stranger[] = "+15550001111";
+	char pin[PIN_LENGTH + 1], line[32];
+	unsigned long sent;
+	unsigned char i;
+	scenario = "sms commands";
+	power_on();
+	SIM_run(2000);
+	strike_out();
+	SIM_run(1000); //alert sent, the lockout lasts at least 10 s
+	sent = SIM_modem.sms;
+	command(contact, SIM_right, "STATUS");
+	check(SIM_modem.sms == sent + 1 && strncmp(SIM_modem.text, "door=closed blocked=", 20) == 0,
+		"status answered");
+	command(contact, SIM_wrong, "UNBLOCK");
+	command(stranger, SIM_right, "UNBLOCK");
+	check(SIM_led(BLOCKED) && SIM_modem.sms == sent + 1, "wrong PIN or sender ignored");
+	for(i = 0; i < PIN_LENGTH; i++){
+		pin[i] = '0' + (7 + i) % 10;
+	}
+	pin[PIN_LENGTH] = '\0';
+	snprintf(line, sizeof(line), "#USER 5 %s", pin);
+	SIM_sms_in(stranger, line);
+	SIM_run(1500);
+	command(contact, SIM_right, "unblock");
+	check(!SIM_led(BLOCKED) && SIM_led(READY), "unblocked by SMS");
+	check(strcmp(SIM_modem.text, "unblocked") == 0, "unblock answered");
+	SIM_pin(pin);
+	check(!SIM_led(0), "SMS text is no service request");
+	SIM_run(2500);
+	snprintf(line, sizeof(line), "PIN %s", pin);
+	command(contact, SIM_right, line);
+	check(strcmp(SIM_modem.text, "PIN changed") == 0, "PIN change answered");
+	SIM_pin(pin);
+	check(SIM_led(0), "new master PIN opens the door");
+	SIM_pin(pin);
+	command(contact, pin, "LOG");
+	check(strncmp(SIM_modem.text, "log close,0@", 12) == 0, "log answered, newest first");
+	SIM_pin(SIM_wrong);
+	SIM_run(2500);
+	SIM_pin(SIM_wrong);
+	SIM_run(2500);
+	for(i = 0; i < SIM_INBOX; i++){
+		SIM_sms_in(contact, i & 1 ? "0 STATUS" : "STATUS");
+	}
+	SIM_pin(SIM_wrong); //lockout commit while the messages are listed
+	check(SIM_led(BLOCKED), "blocked during the burst");
+	SIM_run(LOCKOUT_MS + 5000);
+	check(UART_rx_lost() == 0, "no received byte lost");
+	command(contact, pin, "STATUS");
+	check(strncmp(SIM_modem.text, "door=closed ready", 17) == 0, "commands after the burst");
+}
+
+static void sms_injection(void){
+	
+	//sms_injection(), lines in the text of a message look like the final
+	//result of the listing and like service requests, neither ends the
+	//listing nor reaches the service port, whoever sent the message
+	
+	static const char contact[] = "+95998742925", stranger[] = "+15550001111";
+	char pin[PIN_LENGTH + 1], text[64];
+	unsigned long sent;
+	unsigned char i;
+	scenario = "sms injection";
+	power_on();
+	SIM_run(2000);
+	for(i = 0; i < PIN_LENGTH; i++){
+		pin[i] = '5';
+	}
+	pin[PIN_LENGTH] = '\0';
+	snprintf(text, sizeof(text), "hello\r\nOK\r\n#USER 7 %s", pin);
+	SIM_sms_in(stranger, text);
+	SIM_run(1500);
+	SIM_pin(pin);
+	check(!SIM_led(0), "stranger's text gives no staff PIN");
+	SIM_run(2500);
+	snprintf(text, sizeof(text), "hello\r\nERROR\r\n#USER 6 %s\r\n#ALERT 1 +15550001111", pin);
+	SIM_sms_in(contact, text);
+	SIM_run(1500);
+	SIM_pin(pin);
+	check(!SIM_led(0), "contact's text gives no staff PIN");
+	SIM_run(2500);
+	sent = SIM_modem.sms;
+	strike_out();
+	check(SIM_led(BLOCKED), "blocked after the injection");
+	SIM_run(30000);
+	check(SIM_modem.sms == sent + 1 && strcmp(SIM_modem.number, CONTACT_NUMBER) == 0,
+		"no alert recipient added by SMS text");
+	command(contact, SIM_right, "STATUS");
+	check(strncmp(SIM_modem.text, "door=closed", 11) == 0, "commands after the injection");
+}
+
+static void alerts(void){
+	
+	//alerts(), a lockout alert goes to the contact number and two more
+	//recipients, refused sends are tried again, lockouts during the hold-off
+	//are merged into one message, a recipient is given up after the retries,
+	//a boot in a lockout raises its own alert
+	
+	static const char contact[] = "+95998742925";
+	unsigned long sent, failed_sends;
+	unsigned char i, event, who;
+	unsigned long time;
+	scenario = "alerts";
+	power_on();
+	SIM_run(2000);
+	SIM_service("#ALERT 1 +15550002222");
+	SIM_service("#ALERT 2 +15550003333");
+	SIM_service("#ALERT 3 12ab"); //not a number
+	SIM_run(1000);
+	SIM_modem.fail = 2;
+	strike_out();
+	SIM_run(30000);
+	check(SIM_modem.sms == 3 && SIM_modem.failed == 2, "sent to three recipients after two refusals");
+	check(strcmp(SIM_modem.number, "+15550003333") == 0, "recipients in slot order");
+	check(strcmp(SIM_modem.text, "Alert:\rSystem blocked after 3 wrong passwords") == 0,
+		"one lockout, no count");
+	sent = SIM_modem.sms;
+	for(i = 0; i < 2; i++){
+		command(contact, SIM_right, "UNBLOCK"); //answered at once
+		strike_out();
+		SIM_run(1000);
+	}
+	check(SIM_modem.sms == sent + 2, "alerts held back during the hold-off");
+	SIM_run(ALERT_HOLDOFF_MS / 2 + 10000);
+	check(SIM_modem.sms == sent + 5 && strcmp(SIM_modem.text,
+		"Alert:\rSystem blocked after 3 wrong passwords x2") == 0, "held back alerts in one message");
+	SIM_service("#ALERT 1 OFF");
+	SIM_service("#ALERT 2 OFF");
+	command(contact, SIM_right, "UNBLOCK");
+	sent = SIM_modem.sms;
+	failed_sends = SIM_modem.failed;
+	SIM_modem.fail = 1 + ALERT_RETRIES;
+	strike_out();
+	SIM_run(ALERT_HOLDOFF_MS + 8 * ALERT_RETRY_MS);
+	check(SIM_modem.sms == sent && SIM_modem.failed == failed_sends + 1 + ALERT_RETRIES,
+		"one recipient left, tried again with back-off");
+	check(AUDIT_newest(0, &event, &who, &time) && event == AUDIT_ALERT_LOST && who == 0,
+		"given up alert in the audit log");
+	command(contact, SIM_right, "UNBLOCK");
+	strike_out();
+	SIM_power_cut();
+	HOST_now += 1000;
+	SIM_boot();
+	SIM_run(3000);
+	check(strcmp(SIM_modem.text, "Alert:\rPower cut while blocked") == 0, "boot in a lockout alerted");
+}
+
+static void full_queue(void){
+	
+	//full_queue(), the lockout alert is raised while the AT command queue
+	//has room for one command only, the AT+CMGS of the alert is not queued
+	//without its text, the alert goes out unchanged once the queue drains
+	
+	scenario = "full queue";
+	power_on();
+	SIM_run(2000);
+	SIM_pin(SIM_wrong);
+	SIM_run(2500);
+	SIM_pin(SIM_wrong);
+	SIM_run(2500);
+	SIM_modem.boot_ms = HOST_now + 3600000UL; //modem stops answering
+	while(GSM_queue("AT\r", GSM_OK, 10000, 0, 0, 0)){}
+	while(GSM_free() == 0){
+		SIM_run(100); //the command in progress timed out
+	}
+	SIM_pin(SIM_wrong);
+	check(SIM_led(BLOCKED), "blocked with the queue full");
+	SIM_run(8000);
+	SIM_modem.boot_ms = 0; //answering again
+	SIM_run(60000);
+	check(SIM_modem.sms == 1 && strcmp(SIM_modem.text, "Alert:\rSystem blocked after 3 wrong passwords") == 0,
+		"alert sent unchanged after the queue drained");
+	command("+95998742925", SIM_right, "STATUS");
+	check(SIM_modem.sms == 2 && strncmp(SIM_modem.text, "door=closed", 11) == 0, "modem not left at the prompt");
+}
+
+int main(int argc, char** argv){
+	unsigned long runs = argc > 1 ? strtoul(argv[1], 0, 10) : 1000, i;
+	clock_t start;
+	double seconds;
+	seed = argc > 2 ? strtoul(argv[2], 0, 10) : 1;
+	if(seed == 0){
+		seed = 1;
+	}
+	start = clock();
+	lockout();
+	open_close();
+	staff();
+	audit();
+	sms_commands();
+	sms_injection();
+	alerts();
+	full_queue();
+	for(i = 0; i < runs; i++){
+		power_cuts();
+		slow_modem();
+	}
+	seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+	printf("scenarios %lu, lockout %lu s, seed %s\n", 8 + 2 * runs, (unsigned long)BLOCK_SECONDS,
+		argc > 2 ? argv[2] : "1");
+	printf("virtual   %.1f h in %.3f s\n", HOST_now / 3600000.0, seconds);
+	printf("eeprom    %lu writes\n", HOST_eeprom_writes);
+	printf("%s\n", failed ? "FAILED" : "passed");
+	return failed != 0;
+}
@@ -0,0 +1,294 @@
+//included libraries
+#include <stdio.h>
+#include <string.h>
+#include "config.h"
+#include "sched.h"
+#include "timer.h"
+#include "keypad.h"
+#include "lcd.h"
+#include "keymap.h"
+#include "sleep.h"
+#include "hal_host.h"
+#include "sim.h"
+
+struct SIM_modem SIM_modem;
+unsigned char SIM_uart[4096];
+unsigned int SIM_uart_len;
+char SIM_right[PIN_LENGTH + 1];
+char SIM_wrong[PIN_LENGTH + 1];
+
+static const unsigned char SIM_keymap[16] = KEYMAP_LAYOUT;
+
+static char SIM_line[64]; //command received by the modem
+static unsigned char SIM_len;
+static char SIM_reply[SIM_REPLY]; //answers and URCs, a byte per ms from SIM_reply_at
+static unsigned int SIM_head, SIM_tail;
+static unsigned long SIM_reply_at;
+static unsigned char SIM_text; //message body after the prompt
+static unsigned char SIM_text_len;
+
+//message storage of the module, 0 free, 1 unread, 2 read
+static struct{
+	char sender[16];
+	char text[161];
+	unsigned char state;
+} SIM_inbox[SIM_INBOX];
+
+static void SIM_answer(const char* text){
+	if(SIM_head == SIM_tail){
+		SIM_reply_at = HOST_now + SIM_MODEM_MS; //the module takes its time
+	}
+	while(*text){
+		SIM_reply[SIM_head] = *text++;
+		SIM_head = (SIM_head + 1) & (SIM_REPLY - 1);
+	}
+}
+
+static void SIM_list(void){
+	//AT+CMGL="REC UNREAD", every unread message with its header, then OK,
+	//after AT+CSDH=1 the header ends with the type of the sender address and
+	//the text length
+	char header[96], length[16];
+	unsigned char i;
+	for(i = 0; i < SIM_INBOX; i++){
+		if(SIM_inbox[i].state == 1){
+			length[0] = '\0';
+			if(SIM_modem.csdh){
+				snprintf(length, sizeof(length), ",145,%u", (unsigned)strlen(SIM_inbox[i].text));
+			}
+			snprintf(header, sizeof(header), "\r\n+CMGL: %u,\"REC UNREAD\",\"%.*s\",\"\",\"26/10/16,12:00:00+26\"%s\r\n",
+				i + 1, (int)sizeof(SIM_inbox[i].sender) - 1, SIM_inbox[i].sender, length);
+			SIM_answer(header);
+			SIM_answer(SIM_inbox[i].text);
+			SIM_answer("\r\n");
+			SIM_inbox[i].state = 2;
+		}
+	}
+	SIM_answer("\r\nOK\r\n");
+}
+
+static void SIM_delete(unsigned char all){
+	unsigned char i;
+	for(i = 0; i < SIM_INBOX; i++){
+		if(all || SIM_inbox[i].state == 2){
+			SIM_inbox[i].state = 0;
+		}
+	}
+}
+
+static void SIM_modem_rx(unsigned char c){
+	
+	//SIM_modem_rx() is the GSM module end of the UART, a command ends with a
+	//carriage return, the message body with Ctrl-Z, the module answers OK to
+	//every command, the prompt to AT+CMGS and the message reference to the
+	//body (+CMS ERROR for the next SIM_modem.fail bodies), Ctrl-Z outside of
+	//a message body (in a binary frame) is ignored, before SIM_modem.boot_ms
+	//it does not answer at all, AT+CNMI switches the +CMTI reports of
+	//received messages on, AT+CSDH=1 adds the text length to the listing,
+	//AT+CMGL lists and AT+CMGD deletes the stored ones,
+	//like a real module it finds the AT prefix after the bytes of a frame
+	
+	if(SIM_uart_len < sizeof(SIM_uart)){
+		SIM_uart[SIM_uart_len++] = c; //capture for the runners
+	}
+	if(HOST_now < SIM_modem.boot_ms){
+		SIM_len = 0;
+		return;
+	}
+	if(SIM_text){
+		if(c == 0x1A){
+			SIM_text = 0;
+			SIM_modem.text[SIM_text_len] = '\0';
+			if(SIM_modem.fail > 0){
+				SIM_modem.fail--; //network refused the message
+				SIM_modem.failed++;
+				SIM_answer("\r\n+CMS ERROR: 500\r\n");
+			}
+			else{
+				SIM_modem.sms++;
+				SIM_answer("\r\n+CMGS: 1\r\n\r\nOK\r\n");
+			}
+			SIM_len = 0;
+		}
+		else if(SIM_text_len < sizeof(SIM_modem.text) - 1){
+			SIM_modem.text[SIM_text_len++] = c;
+		}
+		return;
+	}
+	if(c == '\n'){
+		return; //line feeds of the firmware reports
+	}
+	if(c != '\r'){
+		if(c == 'T' && SIM_len > 0 && SIM_line[SIM_len - 1] == 'A'){
+			SIM_line[0] = 'A'; //"AT" starts a command, a frame before it is noise
+			SIM_len = 1;
+		}
+		if(SIM_len < sizeof(SIM_line) - 1){
+			SIM_line[SIM_len++] = c;
+		}
+		return;
+	}
+	SIM_line[SIM_len] = '\0';
+	SIM_len = 0;
+	if(strncmp(SIM_line, "AT", 2) != 0){
+		return; //reports of the firmware
+	}
+	SIM_modem.commands++;
+	if(SIM_modem.ready == 0){
+		SIM_modem.ready = HOST_now;
+	}
+	if(strncmp(SIM_line, "AT+CMGS=\"", 9) == 0){
+		SIM_line[9 + strcspn(SIM_line + 9, "\"")] = '\0';
+		snprintf(SIM_modem.number, sizeof(SIM_modem.number), "%.15s", SIM_line + 9);
+		SIM_answer("\r\n> ");
+		SIM_text = 1;
+		SIM_text_len = 0;
+	}
+	else if(strncmp(SIM_line, "AT+CMGL=", 8) == 0){
+		SIM_list();
+	}
+	else{
+		if(strncmp(SIM_line, "AT+CNMI=", 8) == 0){
+			SIM_modem.cnmi = 1;
+		}
+		else if(strcmp(SIM_line, "AT+CSDH=1") == 0){
+			SIM_modem.csdh = 1;
+		}
+		else if(strcmp(SIM_line, "AT+CMGD=1,1") == 0 || strcmp(SIM_line, "AT+CMGD=1,4") == 0){
+			SIM_delete(SIM_line[10] == '4');
+		}
+		SIM_answer("\r\nOK\r\n");
+	}
+}
+
+unsigned char SIM_sms_in(const char* sender, const char* text){
+	
+	//SIM_sms_in() delivers a message to the module, it is stored and, after
+	//AT+CNMI, reported with +CMTI, returns 0 if the storage is full
+	
+	char urc[32];
+	unsigned char i;
+	for(i = 0; i < SIM_INBOX && SIM_inbox[i].state != 0; i++);
+	if(i == SIM_INBOX){
+		return 0;
+	}
+	snprintf(SIM_inbox[i].sender, sizeof(SIM_inbox[i].sender), "%.15s", sender);
+	snprintf(SIM_inbox[i].text, sizeof(SIM_inbox[i].text), "%.160s", text);
+	SIM_inbox[i].state = 1;
+	SIM_modem.received++;
+	if(SIM_modem.cnmi){
+		snprintf(urc, sizeof(urc), "\r\n+CMTI: \"SM\",%u\r\n", i + 1);
+		SIM_answer(urc);
+	}
+	return 1;
+}
+
+void SIM_boot(void){
+	SIM_len = 0;
+	SIM_text = 0;
+	SIM_head = 0;
+	SIM_tail = 0;
+	HOST_uart_tx = SIM_modem_rx;
+	lock_init();
+}
+
+void SIM_power_cut(void){
+	HOST_power_cut();
+	SIM_head = SIM_tail; //answers in flight are lost
+}
+
+static unsigned char SIM_idle(void){
+	return HOST_keys == 0 && KEYPAD_idle() && LCD_idle() && HOST_idle()
+		&& SIM_head == SIM_tail;
+}
+
+void SIM_run(unsigned long ms){
+	
+	//SIM_run() executes ms virtual milliseconds, when nothing is going on the
+	//clock jumps to the tick before the next timer is due (or the end of the
+	//run), that tick is executed, so the timers expire at their exact tick
+	
+	unsigned long end = HOST_now + ms, skip, next;
+	while((long)(end - HOST_now) > 0){ //busy waits of the firmware move it too
+		if(SIM_idle()){
+			skip = end - HOST_now;
+			next = TIMER_next();
+			if(next != 0 && next < skip){
+				skip = next;
+			}
+			if(skip > 1){
+				HOST_skip(skip - 1);
+			}
+		}
+		HOST_tick();
+		while(SIM_tail != SIM_head && (long)(HOST_now - SIM_reply_at) >= 0){
+			//9600 baud, about a byte per millisecond, bytes due during a busy
+			//wait of the firmware arrive back to back like in the receive ring
+			HOST_uart_rx(SIM_reply[SIM_tail]);
+			SIM_tail = (SIM_tail + 1) & (SIM_REPLY - 1);
+			SIM_reply_at++;
+		}
+		SCHED_run();
+		SLEEP_enter(); //the rest of the millisecond, if there is nothing to do
+	}
+}
+
+void SIM_press(unsigned char key){
+	//held for 20 ms and released for 20 ms, longer than the debounce time
+	HOST_key(key, 1);
+	SIM_run(20);
+	HOST_key(key, 0);
+	SIM_run(20);
+}
+
+void SIM_service(const char* line){
+	//a line on the service port, as if it came from the UART, the firmware
+	//handles it in the next SIM_run(), a carriage return goes first like
+	//from a service tool, it wakes the lock from power-down
+	HOST_uart_rx('\r');
+	while(*line){
+		HOST_uart_rx(*line++);
+	}
+	HOST_uart_rx('\r');
+}
+
+unsigned char SIM_key(unsigned char meaning){
+	//key code of a digit or a KEY_ action in KEYMAP_LAYOUT, 0 if there is none
+	unsigned char key;
+	for(key = 0; key < 16; key++){
+		if(SIM_keymap[key] == meaning){
+			return key + 1;
+		}
+	}
+	return 0;
+}
+
+void SIM_pin(const char* digits){
+	//SIM_pin() enters a PIN like a user, reset key first, then the digits and
+	//the open/close key
+	SIM_press(SIM_key(KEY_RESET));
+	while(*digits){
+		SIM_press(SIM_key(*digits++ - '0'));
+	}
+	SIM_press(SIM_key(KEY_OPEN));
+}
+
+void SIM_erase(void){
+	
+	//SIM_erase() erases the EEPROM and stores the PIN SIM_right (1234... of
+	//PIN_LENGTH digits), SIM_wrong is the same number of zeros
+	
+	unsigned char i;
+	memset(HOST_eeprom, 0xFF, sizeof(HOST_eeprom));
+	for(i = 0; i < PIN_LENGTH; i++){
+		SIM_right[i] = '0' + (i + 1) % 10;
+		SIM_wrong[i] = '0';
+		HOST_eeprom[EEPROM_PASSWORD + i] = (i + 1) % 10;
+	}
+	SIM_right[PIN_LENGTH] = '\0';
+	SIM_wrong[PIN_LENGTH] = '\0';
+}
+
+unsigned char SIM_led(unsigned char pin){
+	return (HOST_out >> pin) & 1;
+}
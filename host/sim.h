@@ -0,0 +1,47 @@
+#ifndef SIM_H
+#define SIM_H
+
+//lock simulator on the host backend
+//SIM_run() advances the virtual clock, the main loop runs after every tick
+//and stretches in which the keypad, the LCD, the EEPROM and the modem are
+//idle are skipped up to the next software timer, so a lockout of an hour
+//costs a few thousand ticks, the GSM module is emulated on the UART, it
+//answers every command after SIM_MODEM_MS at about 9600 baud, counts the sent
+//messages and stores the ones sent to the lock (SIM_sms_in)
+
+#define SIM_MODEM_MS 20
+#define SIM_REPLY 2048 //bytes on the way to the firmware, power of 2
+#define SIM_INBOX 8 //messages the module stores
+
+struct SIM_modem{
+	unsigned long sms; //messages sent
+	unsigned long commands; //AT commands received
+	char number[16]; //recipient of the last message
+	unsigned long ready; //first command answered at, 0 if not yet
+	unsigned long boot_ms; //modem answers only from this virtual time
+	unsigned long received; //messages delivered by SIM_sms_in()
+	unsigned char cnmi; //+CMTI reports on
+	unsigned char csdh; //text length in the +CMGL headers
+	char text[161]; //body of the last message sent
+	unsigned char fail; //next message bodies answered with +CMS ERROR
+	unsigned long failed; //messages answered with +CMS ERROR
+};
+
+extern struct SIM_modem SIM_modem;
+extern unsigned char SIM_uart[4096]; //bytes sent by the firmware
+extern unsigned int SIM_uart_len; //since the runner cleared it
+extern char SIM_right[]; //PIN stored by SIM_erase()
+extern char SIM_wrong[]; //PIN of the same length that does not match
+
+void SIM_boot(void); //power on, the firmware starts from lock_init()
+void SIM_power_cut(void); //power off, SIM_boot() switches it on again
+void SIM_run(unsigned long ms); //virtual milliseconds
+void SIM_press(unsigned char key); //press and release, 40 ms
+void SIM_pin(const char* digits); //reset key, digits, open/close key
+unsigned char SIM_key(unsigned char meaning); //key code of a digit or KEY_ action
+void SIM_service(const char* line); //line received on the service port
+unsigned char SIM_sms_in(const char* sender, const char* text); //message to the lock
+void SIM_erase(void); //erased EEPROM with the PIN SIM_right
+unsigned char SIM_led(unsigned char pin); //state of an output PORT pin
+
+#endif
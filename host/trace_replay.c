@@ -0,0 +1,609 @@
+//included libraries
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "config.h"
+#include "frame.h"
+#include "trace.h"
+#include "sched.h"
+#include "timer.h"
+#include "tick.h"
+#include "keypad.h"
+#include "lcd.h"
+#include "sleep.h"
+#include "gsm.h"
+#include "keymap.h"
+#include "hal_host.h"
+#include "sim.h"
+
+//trace record and replay, build with -DTRACE=1
+//record: the lock firmware runs a seeded mix of PINs, PIN changes, lockouts
+//and status requests by SMS in the simulator, optionally with key bounce,
+//the runner asks for the EEPROM image after the boot and for the trace every
+//TRACE_ASK_MS like a service tool and writes every byte the firmware sends to
+//the capture file
+//replay: the trace frames of a capture are joined, the EEPROM image at the
+//boot is the image of the capture with the first old value of every traced
+//write, the firmware boots from it and gets the keypad samples and received
+//bytes of the trace at their millisecond, the stretches without input or
+//timer are skipped, its own trace is compared with the recorded one, output
+//PORT (relay, buzzer, LEDs), LCD cells, EEPROM writes and the sent byte
+//stream, records of a class are compared in order, the report is one JSON
+//object with the mismatches, the first divergence and the largest time skew
+//of every class and the speed of the replay, exit status 1 on a divergence,
+//2 if the capture can not be replayed
+//usage: trace_replay -r capture [rounds] [seed] [bounce]
+//       trace_replay capture
+
+#define TRACE_ASK_MS 250
+#define SLICE_MS 50 //simulator run between two drains of the capture
+#define RECORDS_MAX 1000000
+
+struct record{
+	unsigned long time;
+	unsigned char type;
+	unsigned char d[4];
+};
+
+//joined trace of a capture
+struct trace{
+	struct record* r;
+	unsigned long n;
+	unsigned long last; //time of the newest record
+	unsigned long frames;
+	unsigned long dropped;
+	unsigned long gaps; //frames which do not start at the end of the previous one
+	unsigned char image[1024];
+	unsigned char has_image;
+};
+
+//comparison of one record class
+struct diff{
+	unsigned long recorded, replayed;
+	unsigned long mismatch;
+	long first; //time of the first divergence, -1 none
+	unsigned long skew; //largest time difference of a matching pair
+};
+
+static const unsigned char lengths[TRACE_TYPES] = {1, 1, 2, 4, 1, 2};
+
+static unsigned long seed;
+static unsigned char bounce;
+static FILE* capture;
+static unsigned long asked; //virtual time of the last trace request
+static char pin[PIN_LENGTH + 1];
+
+static unsigned char* tx; //bytes sent by the replayed firmware
+static unsigned long tx_len, tx_size;
+
+static struct trace rec, rep;
+static unsigned long key_next, rx_next; //next input record of the replay
+
+static unsigned long trace_random(unsigned long n){
+	//xorshift32, 0 to n - 1
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	seed &= 0xFFFFFFFFUL;
+	return seed % n;
+}
+
+static void drain(void){
+	fwrite(SIM_uart, 1, SIM_uart_len, capture);
+	SIM_uart_len = 0;
+}
+
+static void run(unsigned long ms){
+
+	//run() is SIM_run() in slices, the capture buffer of the simulator is
+	//drained after every slice and the trace is asked for every TRACE_ASK_MS,
+	//not while the lock talks to the modem, a line on the shared port would
+	//cut the SMS prompt
+
+	unsigned long slice;
+	while(ms > 0){
+		slice = ms < SLICE_MS ? ms : SLICE_MS;
+		SIM_run(slice);
+		ms -= slice;
+		drain();
+		if(HOST_now - asked >= TRACE_ASK_MS && GSM_idle()){
+			asked = HOST_now;
+			SIM_service("#TRACE");
+		}
+	}
+}
+
+static void press(unsigned char key){
+
+	//press() holds a key for 20 ms like SIM_press(), with bounce the contact
+	//chatters for the first milliseconds of the press and the release
+
+	unsigned char i, n = bounce ? trace_random(4) : 0;
+	for(i = 0; i < n; i++){
+		HOST_key(key, 1);
+		run(1);
+		HOST_key(key, 0);
+		run(1);
+	}
+	HOST_key(key, 1);
+	run(20);
+	n = bounce ? trace_random(4) : 0;
+	for(i = 0; i < n; i++){
+		HOST_key(key, 0);
+		run(1);
+		HOST_key(key, 1);
+		run(1);
+	}
+	HOST_key(key, 0);
+	run(20);
+}
+
+static void enter(const char* digits){
+	press(SIM_key(KEY_RESET));
+	while(*digits){
+		press(SIM_key(*digits++ - '0'));
+	}
+	press(SIM_key(KEY_OPEN));
+}
+
+static void round_mix(void){
+
+	//round_mix() is one visit at the door, the mix of lock_bench with a
+	//status request by SMS now and then
+
+	char wrong[PIN_LENGTH + 1], sms[PIN_LENGTH + 8];
+	unsigned long r = trace_random(100), i;
+	if(r < 55){
+		enter(pin); //open
+		enter(pin); //close
+	}
+	else if(r < 80){
+		for(i = 0; i < PIN_LENGTH; i++){
+			wrong[i] = '0' + trace_random(10);
+		}
+		wrong[PIN_LENGTH] = '\0';
+		enter(wrong);
+		run(2500);
+	}
+	else if(r < 90){
+		enter(pin); //open, the PIN matches
+		press(SIM_key(KEY_CHANGE));
+		for(i = 0; i < PIN_LENGTH; i++){
+			pin[i] = '0' + trace_random(10);
+			press(SIM_key(pin[i] - '0'));
+		}
+		press(SIM_key(KEY_SET));
+		press(SIM_key(KEY_OPEN)); //close
+	}
+	else if(r < 95){
+		snprintf(sms, sizeof(sms), "%s STATUS", pin);
+		SIM_sms_in("+95998742925", sms);
+		run(2000);
+	}
+	else{
+		for(i = 0; i < 3; i++){
+			enter(SIM_wrong);
+			run(2500);
+		}
+		run(BLOCK_SECONDS * 1000UL + 1000); //lockout
+	}
+}
+
+static int record(const char* path, unsigned long rounds){
+	unsigned long i;
+	capture = fopen(path, "wb");
+	if(!capture){
+		perror(path);
+		return 2;
+	}
+	HOST_reset();
+	SIM_erase();
+	strcpy(pin, SIM_right);
+	SIM_boot();
+	run(1000);
+	SIM_service("#EEPROM");
+	for(i = 0; i < rounds; i++){
+		round_mix();
+	}
+	run(TRACE_ASK_MS + SLICE_MS); //the last records go out
+	fclose(capture);
+	printf("{\"rounds\":%lu,\"virtual_ms\":%lu,\"sms\":%lu}\n", rounds, HOST_now, SIM_modem.sms);
+	return 0;
+}
+
+static unsigned long le(const unsigned char* p, unsigned char n){
+	unsigned long v = 0;
+	while(n--){
+		v = (v << 8) | p[n];
+	}
+	return v;
+}
+
+static void join(struct trace* t, const unsigned char* p, unsigned long len){
+
+	//join() appends the records of a FRAME_TRACE payload, the frame has to
+	//start at the newest record of the previous one
+
+	unsigned long time, end = len;
+	unsigned char type, delta;
+	struct record* r;
+	if(len < 10){
+		t->gaps++;
+		return;
+	}
+	t->frames++;
+	t->dropped += le(p + 8, 2);
+	if(le(p + 4, 4) != t->last){
+		t->gaps++;
+	}
+	time = le(p + 4, 4);
+	for(p += 10, len = 10; len < end; ){
+		type = p[0] >> 5;
+		delta = p[0] & 0x1F;
+		p++;
+		len++;
+		if(delta == TRACE_DELTA){
+			time += le(p, 2);
+			p += 2;
+			len += 2;
+		}
+		else if(delta == TRACE_TIME){
+			time = le(p, 4);
+			p += 4;
+			len += 4;
+		}
+		else{
+			time += delta;
+		}
+		if(type >= TRACE_TYPES || len + lengths[type] > end || t->n == RECORDS_MAX){
+			t->gaps++; //broken record, the rest of the frame is lost
+			return;
+		}
+		r = &t->r[t->n++];
+		r->time = time;
+		r->type = type;
+		memcpy(r->d, p, lengths[type]);
+		p += lengths[type];
+		len += lengths[type];
+	}
+	t->last = time;
+}
+
+static void parse(struct trace* t, const unsigned char* buf, unsigned long size){
+
+	//parse() takes the frames out of a capture, text between them (AT
+	//commands, reports) is skipped, so is a frame with a wrong CRC
+
+	unsigned long i = 0, j, len;
+	unsigned char crc;
+	t->r = malloc(sizeof(struct record) * RECORDS_MAX);
+	while(i + 5 <= size){
+		if(buf[i] != FRAME_SYNC){
+			i++;
+			continue;
+		}
+		len = buf[i + 2] | (buf[i + 3] << 8);
+		if(i + 5 + len > size){
+			break;
+		}
+		for(crc = 0, j = 1; j < len + 4; j++){
+			crc = FRAME_crc8(crc, buf[i + j]);
+		}
+		if(crc != buf[i + 4 + len]){
+			i++;
+			continue;
+		}
+		if(buf[i + 1] == FRAME_TRACE){
+			join(t, buf + i + 4, len);
+		}
+		else if(buf[i + 1] == FRAME_EEPROM && len == sizeof(t->image) && !t->has_image){
+			memcpy(t->image, buf + i + 4, len);
+			t->has_image = 1;
+		}
+		i += 5 + len;
+	}
+}
+
+static void replay_tx(unsigned char c){
+	if(tx_len == tx_size){
+		tx_size = tx_size ? tx_size * 2 : 65536;
+		tx = realloc(tx, tx_size);
+	}
+	tx[tx_len++] = c;
+}
+
+static void next_input(void){
+	while(key_next < rec.n && rec.r[key_next].type != TRACE_KEY){
+		key_next++;
+	}
+	while(rx_next < rec.n && rec.r[rx_next].type != TRACE_RX){
+		rx_next++;
+	}
+}
+
+static void replay_keys(void){
+
+	//replay_keys() runs after every tick, a column sample of the trace was
+	//read by the scan of its millisecond, so the keys are set on the tick
+	//before it
+
+	unsigned char column, row;
+	unsigned long now = TICK_now();
+	while(key_next < rec.n && TICK_reached(now + 1, rec.r[key_next].time)){
+		column = rec.r[key_next].d[0] >> 4;
+		for(row = 0; row < 4; row++){
+			if(rec.r[key_next].d[0] & (1 << row)){
+				HOST_keys |= 1U << (row * 4 + column);
+			}
+			else{
+				HOST_keys &= ~(1U << (row * 4 + column));
+			}
+		}
+		key_next++;
+		next_input();
+	}
+}
+
+static void replay_rx(void){
+	unsigned long now = TICK_now();
+	while(rx_next < rec.n && TICK_reached(now, rec.r[rx_next].time)){
+		HOST_uart_rx(rec.r[rx_next].d[0]);
+		rx_next++;
+		next_input();
+	}
+}
+
+static unsigned char replay_idle(void){
+	return HOST_keys == 0 && KEYPAD_idle() && LCD_idle() && HOST_idle();
+}
+
+static void replay(void){
+
+	//replay() runs the firmware to the newest recorded record like SIM_run(),
+	//an idle stretch ends on the tick before a key sample is due (the keys
+	//are set after it) or on the tick of a received byte
+
+	unsigned long skip, next;
+	unsigned char boot[1024];
+	unsigned long i;
+	memcpy(boot, rec.image, sizeof(boot));
+	for(i = rec.n; i-- > 0; ){
+		if(rec.r[i].type == TRACE_EEPROM){
+			boot[le(rec.r[i].d, 2) & 0x3FF] = rec.r[i].d[2]; //first write of a cell wins
+		}
+	}
+	HOST_reset();
+	memcpy(HOST_eeprom, boot, sizeof(boot));
+	HOST_uart_tx = replay_tx;
+	HOST_tick_hook = replay_keys;
+	key_next = 0;
+	rx_next = 0;
+	next_input();
+	lock_init();
+	while((long)(rec.last - TICK_now()) > 0){
+		if(replay_idle()){
+			skip = rec.last - TICK_now();
+			next = TIMER_next();
+			if(next != 0 && next < skip){
+				skip = next;
+			}
+			if(key_next < rec.n && (long)(rec.r[key_next].time - 1 - TICK_now()) < (long)skip){
+				skip = rec.r[key_next].time - 1 - TICK_now();
+			}
+			if(rx_next < rec.n && (long)(rec.r[rx_next].time - TICK_now()) < (long)skip){
+				skip = rec.r[rx_next].time - TICK_now();
+			}
+			if((long)skip > 1){
+				HOST_skip(skip - 1);
+			}
+		}
+		HOST_tick();
+		replay_rx();
+		SCHED_run();
+		SLEEP_enter();
+	}
+	TRACE_send(); //records since the last request
+	HOST_tick_hook = 0;
+}
+
+static void compare(struct diff* d, unsigned char type, unsigned char n){
+
+	//compare() pairs the records of a class in their order, the data has to
+	//be equal, the times may differ by a few ms when an input lands on the
+	//other side of a main loop pass
+
+	unsigned long i = 0, j = 0, dt;
+	memset(d, 0, sizeof(*d));
+	d->first = -1;
+	for(;;){
+		while(i < rec.n && rec.r[i].type != type){
+			i++;
+		}
+		while(j < rep.n && (rep.r[j].type != type || rep.r[j].time > rec.last)){
+			j++;
+		}
+		if(i == rec.n && j == rep.n){
+			break;
+		}
+		if(i == rec.n || j == rep.n){
+			if(d->first < 0){
+				d->first = i < rec.n ? rec.r[i].time : rep.r[j].time;
+			}
+			d->mismatch++;
+		}
+		else if(memcmp(rec.r[i].d, rep.r[j].d, n) != 0){
+			if(d->first < 0){
+				d->first = rec.r[i].time < rep.r[j].time ? rec.r[i].time : rep.r[j].time;
+			}
+			d->mismatch++;
+		}
+		else{
+			dt = rec.r[i].time > rep.r[j].time ? rec.r[i].time - rep.r[j].time : rep.r[j].time - rec.r[i].time;
+			if(dt > d->skew){
+				d->skew = dt;
+			}
+		}
+		if(i < rec.n){
+			d->recorded++;
+			i++;
+		}
+		if(j < rep.n){
+			d->replayed++;
+			j++;
+		}
+	}
+}
+
+static unsigned long stream(const struct trace* t, struct record* out){
+
+	//stream() turns the TX records into checkpoints of the sent byte stream,
+	//the time, the bytes sent up to the end of the record (d[0] - d[2]) and
+	//the CRC of them (d[3])
+
+	unsigned long i, n = 0, bytes = 0;
+	for(i = 0; i < t->n; i++){
+		if(t->r[i].type == TRACE_TX && t->r[i].time <= rec.last){
+			bytes += t->r[i].d[0];
+			out[n].time = t->r[i].time;
+			out[n].d[0] = bytes;
+			out[n].d[1] = bytes >> 8;
+			out[n].d[2] = bytes >> 16;
+			out[n].d[3] = t->r[i].d[1];
+			n++;
+		}
+	}
+	return n;
+}
+
+static void compare_tx(struct diff* d){
+
+	//compare_tx() walks the sent byte streams, the bytes of a millisecond
+	//may be split in other records in the replay, so the CRCs are compared
+	//where both streams have a record ending at the same byte, at the end
+	//the byte counts as well
+
+	struct record* a = malloc(sizeof(struct record) * (rec.n + 1));
+	struct record* b = malloc(sizeof(struct record) * (rep.n + 1));
+	unsigned long na = stream(&rec, a), nb = stream(&rep, b), i = 0, j = 0, ea, eb, dt;
+	memset(d, 0, sizeof(*d));
+	d->first = -1;
+	d->recorded = na;
+	d->replayed = nb;
+	while(i < na && j < nb){
+		ea = le(a[i].d, 3);
+		eb = le(b[j].d, 3);
+		if(ea < eb){
+			i++;
+			continue;
+		}
+		if(eb < ea){
+			j++;
+			continue;
+		}
+		dt = a[i].time > b[j].time ? a[i].time - b[j].time : b[j].time - a[i].time;
+		if(a[i].d[3] != b[j].d[3]){
+			if(d->first < 0){
+				d->first = a[i].time;
+			}
+			d->mismatch++;
+		}
+		else if(dt > d->skew){
+			d->skew = dt;
+		}
+		i++;
+		j++;
+	}
+	if((na ? le(a[na - 1].d, 3) : 0) != (nb ? le(b[nb - 1].d, 3) : 0)){
+		if(d->first < 0){
+			d->first = rec.last;
+		}
+		d->mismatch++;
+	}
+	free(a);
+	free(b);
+}
+
+static void json_diff(const char* name, const struct diff* d, const char* sep){
+	printf("\"%s\":{\"recorded\":%lu,\"replayed\":%lu,\"mismatch\":%lu,\"first_ms\":%ld,\"max_skew_ms\":%lu}%s\n",
+		name, d->recorded, d->replayed, d->mismatch, d->first, d->skew, sep);
+}
+
+static unsigned long count(const struct trace* t, unsigned char type){
+	unsigned long i, n = 0;
+	for(i = 0; i < t->n; i++){
+		n += t->r[i].type == type;
+	}
+	return n;
+}
+
+static int replay_capture(const char* path){
+	static const char* const names[] = {"out", "lcd", "eeprom"};
+	static const unsigned char types[] = {TRACE_OUT, TRACE_LCD, TRACE_EEPROM};
+	struct diff d[4];
+	struct timespec a, b;
+	unsigned char* buf;
+	unsigned long size;
+	unsigned char k, divergent;
+	double wall;
+	FILE* f = fopen(path, "rb");
+	if(!f){
+		perror(path);
+		return 2;
+	}
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	buf = malloc(size ? size : 1);
+	if(fread(buf, 1, size, f) != size){
+		perror(path);
+		return 2;
+	}
+	fclose(f);
+	parse(&rec, buf, size);
+	if(!rec.has_image || rec.frames == 0){
+		fprintf(stderr, "%s: no EEPROM image or no trace\n", path);
+		return 2;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &a);
+	replay();
+	clock_gettime(CLOCK_MONOTONIC, &b);
+	wall = (b.tv_sec - a.tv_sec) + (b.tv_nsec - a.tv_nsec) / 1e9;
+	parse(&rep, tx, tx_len);
+	for(k = 0; k < 3; k++){
+		compare(&d[k], types[k], lengths[types[k]]);
+	}
+	compare_tx(&d[3]);
+	divergent = rec.dropped || rec.gaps || rep.dropped || rep.gaps;
+	for(k = 0; k < 4; k++){
+		divergent |= d[k].mismatch != 0;
+	}
+	printf("{\n\"records\":%lu,\"frames\":%lu,\"dropped\":%lu,\"gaps\":%lu,\"keys\":%lu,\"rx\":%lu,\n",
+		rec.n, rec.frames, rec.dropped, rec.gaps, count(&rec, TRACE_KEY), count(&rec, TRACE_RX));
+	printf("\"replay\":{\"virtual_ms\":%lu,\"wall_s\":%.6f,\"speedup\":%.0f,\"dropped\":%lu,\"gaps\":%lu},\n",
+		rec.last, wall, wall > 0 ? rec.last / 1000.0 / wall : 0.0, rep.dropped, rep.gaps);
+	printf("\"outputs\":{\n");
+	for(k = 0; k < 3; k++){
+		json_diff(names[k], &d[k], ",");
+	}
+	json_diff("tx", &d[3], "");
+	printf("},\n\"divergent\":%u\n}\n", divergent);
+	return divergent;
+}
+
+int main(int argc, char** argv){
+	if(argc > 2 && strcmp(argv[1], "-r") == 0){
+		seed = argc > 4 ? strtoul(argv[4], 0, 10) : 1;
+		if(seed == 0){
+			seed = 1;
+		}
+		bounce = argc > 5 ? atoi(argv[5]) != 0 : 0;
+		return record(argv[2], argc > 3 ? strtoul(argv[3], 0, 10) : 100);
+	}
+	if(argc == 2){
+		return replay_capture(argv[1]);
+	}
+	fprintf(stderr, "usage: trace_replay -r capture [rounds] [seed] [bounce]\n"
+		"       trace_replay capture\n");
+	return 2;
+}
@@ -0,0 +1,118 @@
+//included libraries
+#include "config.h"
+#include "journal.h"
+#include "eeprom.h"
+
+//record layout, 8 bytes
+//0 - 1 sequence number, 2 block flag, 3 - 4 wait, 5 - 6 reserved, 7 CRC-8
+#define JOURNAL_RECORD 8
+
+struct JOURNAL_state JOURNAL_cache; //current state, reads never touch EEPROM
+static struct JOURNAL_state JOURNAL_saved; //state of the newest record
+static unsigned int JOURNAL_seq; //sequence number of the newest record
+static unsigned char JOURNAL_slot; //slot of the newest record
+static unsigned int JOURNAL_count; //records written since boot
+
+static unsigned char JOURNAL_crc(const unsigned char* data, unsigned char len){
+	//CRC-8, polynomial x^8 + x^2 + x + 1
+	unsigned char crc = 0, bit;
+	while(len--){
+		crc ^= *data++;
+		for(bit = 0; bit < 8; bit++){
+			crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+		}
+	}
+	return crc;
+}
+
+static unsigned char JOURNAL_read(unsigned char slot, unsigned char* rec){
+	//read one record, returns 1 if it is valid
+	unsigned char i;
+	int addr = JOURNAL_BASE + slot * JOURNAL_RECORD;
+	for(i = 0; i < JOURNAL_RECORD; i++){
+		rec[i] = EEPROM_read(addr + i);
+	}
+	if(rec[0] == 0xFF && rec[1] == 0xFF){
+		return 0; //erased slot
+	}
+	return JOURNAL_crc(rec, JOURNAL_RECORD - 1) == rec[JOURNAL_RECORD - 1];
+}
+
+void JOURNAL_load(void){
+	
+	//JOURNAL_load() scans the whole ring once at boot, sequence numbers are
+	//compared with 16 bit serial number arithmetic, so the counter can wrap
+	//(whatever the size of an int), a record torn by a power cut fails the
+	//CRC and the previous one is used instead
+	//an empty journal falls back to the block flag of the old fixed layout
+	
+	unsigned char slot, rec[JOURNAL_RECORD], found = 0;
+	unsigned int seq;
+	JOURNAL_count = 0;
+	JOURNAL_saved.block = 0;
+	JOURNAL_saved.wait = 0;
+	JOURNAL_seq = 0;
+	JOURNAL_slot = JOURNAL_SLOTS - 1; //first record goes to slot 0
+	for(slot = 0; slot < JOURNAL_SLOTS; slot++){
+		if(!JOURNAL_read(slot, rec)){
+			continue;
+		}
+		seq = rec[0] | (rec[1] << 8);
+		if(!found || (signed short)(seq - JOURNAL_seq) > 0){
+			found = 1;
+			JOURNAL_seq = seq;
+			JOURNAL_slot = slot;
+			JOURNAL_saved.block = rec[2];
+			JOURNAL_saved.wait = rec[3] | (rec[4] << 8);
+		}
+	}
+	if(!found && EEPROM_read(EEPROM_LEGACY_BLOCK) == 1){
+		JOURNAL_saved.block = 1; //blocked by the firmware without journal
+	}
+	JOURNAL_cache = JOURNAL_saved;
+}
+
+void JOURNAL_commit(void){
+	//write the cached state into the next slot, the record is complete only
+	//when its CRC byte, written last, matches
+	unsigned char i, rec[JOURNAL_RECORD];
+	int addr;
+	if(JOURNAL_cache.block == JOURNAL_saved.block && JOURNAL_cache.wait == JOURNAL_saved.wait){
+		return; //newest record already holds this state
+	}
+	JOURNAL_seq = (JOURNAL_seq + 1) & 0xFFFF;
+	if(JOURNAL_seq == 0xFFFF){
+		JOURNAL_seq = 0; //0xFFFF marks an erased slot, 0 is 2 ahead of 0xFFFE
+	}
+	JOURNAL_slot = (JOURNAL_slot + 1) % JOURNAL_SLOTS;
+	rec[0] = JOURNAL_seq & 0xFF;
+	rec[1] = JOURNAL_seq >> 8;
+	rec[2] = JOURNAL_cache.block;
+	rec[3] = JOURNAL_cache.wait & 0xFF;
+	rec[4] = JOURNAL_cache.wait >> 8;
+	rec[5] = 0xFF;
+	rec[6] = 0xFF;
+	rec[7] = JOURNAL_crc(rec, JOURNAL_RECORD - 1);
+	addr = JOURNAL_BASE + JOURNAL_slot * JOURNAL_RECORD;
+	for(i = 0; i < JOURNAL_RECORD; i++){
+		EEPROM_write(addr + i, rec[i]); //queued, unchanged bytes are not written
+	}
+	JOURNAL_saved = JOURNAL_cache;
+	JOURNAL_count++;
+}
+
+void JOURNAL_update(unsigned char block, unsigned int wait){
+	//update the cached state, a change of the block flag is written at once,
+	//the lockout time only every JOURNAL_CHECKPOINT seconds, after a power cut
+	//the lockout continues from the last checkpoint, so it can only get longer
+	JOURNAL_cache.block = block;
+	JOURNAL_cache.wait = wait;
+	if(block != JOURNAL_saved.block || wait - JOURNAL_saved.wait >= JOURNAL_CHECKPOINT){
+		JOURNAL_commit();
+	}
+}
+
+unsigned int JOURNAL_writes(void){
+	//number of records written since boot
+	return JOURNAL_count;
+}
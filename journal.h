@@ -0,0 +1,23 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+//wear leveled lock state journal
+//the lock state (block flag and seconds elapsed in the lockout) is kept in RAM
+//and written as CRC protected records with a rising sequence number into a
+//ring of JOURNAL_SLOTS EEPROM slots, each write goes to the next slot, so the
+//wear is spread over the whole ring, at boot the valid record with the
+//highest sequence number is the current state
+
+struct JOURNAL_state{
+	unsigned char block; //1 if the system is blocked
+	unsigned int wait; //seconds elapsed since the system was blocked
+};
+
+extern struct JOURNAL_state JOURNAL_cache;
+
+void JOURNAL_load(void);
+void JOURNAL_update(unsigned char block, unsigned int wait);
+void JOURNAL_commit(void);
+unsigned int JOURNAL_writes(void);
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef KEYMAP_H
+#define KEYMAP_H
+
+//keypad layout
+//KEYMAP_LAYOUT in config.h gives the meaning of the 16 matrix keys in key code
+//order (row * 4 + column), digits 0 - 9 stand for themselves, the other keys
+//are one of the actions below, run_key_function() finds the handler of a key
+//with two table lookups, a door model with another keypad only changes the
+//layout, PIN_LENGTH sets the number of PIN digits
+
+#define KEY_CLEAR 10 //remove the last digit
+#define KEY_CHANGE 11 //start a new PIN, after the right PIN
+#define KEY_SET 12 //store the entered PIN, after the right PIN
+#define KEY_RESET 13 //clear the entered digits
+#define KEY_SHOW 14 //show or hide the digits
+#define KEY_OPEN 15 //check the PIN, open or close the door
+#define KEY_ACTIONS 16 //digits and actions
+
+#define PIN_EMPTY 10 //digit not entered yet
+
+#endif
@@ -0,0 +1,114 @@
+//included libraries
+#include "config.h"
+#include "hal.h"
+#include "keypad.h"
+#include "trace.h"
+
+//event ring, KEYPAD_head is written only by the scanner interrupt and
+//KEYPAD_tail only by the main loop, so no locking is needed
+static volatile unsigned char KEYPAD_ring[KEYPAD_QUEUE];
+static volatile unsigned char KEYPAD_head, KEYPAD_tail;
+static volatile unsigned int KEYPAD_lost; //events dropped on a full ring
+
+static unsigned char KEYPAD_column; //column driven since the previous tick
+static unsigned char KEYPAD_count[16]; //equal samples in a row for each key
+static unsigned int KEYPAD_state; //debounced state, bit (key - 1) set if pressed
+
+void KEYPAD_init(void){
+	//matrix columns are connected to PORT pins PB0 - PB3, rows to PB4 - PB7
+	unsigned char i;
+	KEYPAD_head = 0;
+	KEYPAD_tail = 0;
+	KEYPAD_lost = 0;
+	KEYPAD_state = 0;
+	for(i = 0; i < 16; i++){
+		KEYPAD_count[i] = 0;
+	}
+	KEYPAD_column = 0;
+	HAL_matrix_column(0); //enable first column
+}
+
+static void KEYPAD_push(unsigned char event){
+	unsigned char next = (KEYPAD_head + 1) & (KEYPAD_QUEUE - 1);
+	if(next == KEYPAD_tail){
+		KEYPAD_lost++; //ring is full, main loop did not keep up
+		return;
+	}
+	KEYPAD_ring[KEYPAD_head] = event;
+	KEYPAD_head = next; //publish the event after it is stored
+}
+
+unsigned char KEYPAD_scan(void){
+	
+	//KEYPAD_scan() reads the rows of the column which was enabled on the previous
+	//tick, so the lines had a whole millisecond to settle, and then enables the
+	//next column, every key of the column goes through the debounce state
+	//machine, the raw sample has to differ from the debounced state for
+	//KEYPAD_DEBOUNCE scans in a row before the state changes and an event is
+	//pushed, a single bounce resets the counter, returns 1 if an event was pushed
+	
+	unsigned char rows, row, key, pushed = 0;
+	unsigned int mask;
+	rows = HAL_matrix_rows(); //read rows data of the active column
+	TRACE_key(KEYPAD_column, rows);
+	for(row = 0; row < 4; row++){
+		key = row * 4 + KEYPAD_column; //key index 0 to 15
+		mask = 1U << key;
+		if(((rows & (1 << row)) != 0) != ((KEYPAD_state & mask) != 0)){
+			if(++KEYPAD_count[key] >= KEYPAD_DEBOUNCE){
+				KEYPAD_count[key] = 0;
+				KEYPAD_state ^= mask; //state is stable, accept it
+				KEYPAD_push((KEYPAD_state & mask) ? key + 1 : (key + 1) | KEYPAD_RELEASE);
+				pushed = 1;
+			}
+		}
+		else{
+			KEYPAD_count[key] = 0; //sample agrees with the state, bounce is over
+		}
+	}
+	KEYPAD_column = (KEYPAD_column + 1) & 0x03;
+	HAL_matrix_column(KEYPAD_column); //enable next column
+	return pushed;
+}
+
+unsigned char KEYPAD_get_event(void){
+	//take the oldest event out of the ring, KEYPAD_NONE if the ring is empty
+	unsigned char event;
+	if(KEYPAD_tail == KEYPAD_head){
+		return KEYPAD_NONE;
+	}
+	event = KEYPAD_ring[KEYPAD_tail];
+	KEYPAD_tail = (KEYPAD_tail + 1) & (KEYPAD_QUEUE - 1); //free the slot
+	return event;
+}
+
+unsigned int KEYPAD_dropped(void){
+	unsigned int lost;
+	HAL_ATOMIC{
+		lost = KEYPAD_lost;
+	}
+	return lost;
+}
+
+unsigned char KEYPAD_idle(void){
+	//true if every key is released and no debounce is in progress, scans do
+	//not change anything then
+	unsigned char i;
+	if(KEYPAD_state != 0){
+		return 0;
+	}
+	for(i = 0; i < 16; i++){
+		if(KEYPAD_count[i] != 0){
+			return 0;
+		}
+	}
+	return 1;
+}
+
+void KEYPAD_skip(unsigned long ms){
+	//ticks skipped while idle (TICK_skip()), the column moves on as if they
+	//had scanned the released keys, so a key is read at the same tick as
+	//without the skip
+	KEYPAD_column = (KEYPAD_column + ms) & 0x03;
+	HAL_matrix_column(KEYPAD_column);
+}
@@ -0,0 +1,20 @@
+#ifndef KEYPAD_H
+#define KEYPAD_H
+
+//4x4 keypad matrix scanner
+//KEYPAD_scan() runs from the 1 ms timer tick, debounces every key with its own
+//sample counter and pushes press and release events into a single producer
+//single consumer ring, the main loop takes them out with KEYPAD_get_event()
+//key codes are 1 to 16 (row * 4 + column), release events have bit 7 set
+
+#define KEYPAD_NONE 0
+#define KEYPAD_RELEASE 0x80
+
+void KEYPAD_init(void);
+unsigned char KEYPAD_scan(void);
+unsigned char KEYPAD_get_event(void);
+unsigned int KEYPAD_dropped(void);
+unsigned char KEYPAD_idle(void);
+void KEYPAD_skip(unsigned long ms);
+
+#endif
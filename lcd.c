@@ -0,0 +1,234 @@
+//included libraries
+#include "config.h"
+#include "hal.h"
+#include "lcd.h"
+#include "trace.h"
+
+//shadow framebuffer, one bit per cell in LCD_dirty marks characters which
+//differ from what the controller is showing
+static char LCD_frame[LCD_ROWS][LCD_COLS];
+static volatile unsigned int LCD_dirty[LCD_ROWS];
+static unsigned char LCD_row, LCD_col; //framebuffer cursor used by LCD_put()
+static volatile unsigned char LCD_cursor; //DDRAM address of the controller cursor
+
+//bytes written into the framebuffer by the UI and bytes sent on the LCD bus
+static unsigned long LCD_written;
+static volatile unsigned long LCD_flushed;
+
+//per command class wait statistics
+static struct LCD_wait_stat LCD_waits[LCD_WAIT_CLASSES];
+
+//one busy flag poll takes about 2 us (EN pulse and PORT switching), a data
+//write or an ordinary command finishes in 37 us, clear and home in 1.52 ms
+#define LCD_POLL_US 2
+#define LCD_POLL_LIMIT 1000 //give up after ~2 ms, controller is missing
+#define LCD_BURST_POLLS 32 //~64 us, longer than any command LCD_flush() sends
+
+static void LCD_bus_write(unsigned char rs, unsigned char byte){
+	//one write cycle on the LCD bus, the execution time (~40 us) is covered by
+	//the caller
+	HAL_lcd_write(rs, byte);
+}
+
+static void LCD_wait_record(unsigned char cls, unsigned int us){
+	struct LCD_wait_stat* stat = &LCD_waits[cls];
+	stat->count++;
+	stat->total += us;
+	if(us > stat->max){
+		stat->max = us;
+	}
+}
+
+static unsigned char LCD_cmd_class(unsigned char cmnd){
+	//clear (0x01) and return home (0x02 or 0x03) are the slow commands
+	return (cmnd == 0x01 || (cmnd & 0xFE) == 0x02) ? LCD_WAIT_CLEAR : LCD_WAIT_CMD;
+}
+
+#if LCD_BUSY_FLAG
+static unsigned char LCD_busy(void){
+	//busy flag is DB7 of the status register
+	return HAL_lcd_status() & 0x80;
+}
+
+static unsigned char LCD_wait_ready(unsigned char cls, unsigned int limit){
+	//poll the busy flag until the controller is ready or limit polls have been
+	//made, returns 1 if the controller is ready
+	unsigned int polls = 0;
+	while(LCD_busy()){
+		if(++polls >= limit){
+			LCD_wait_record(cls, polls * LCD_POLL_US);
+			return 0; //controller still busy
+		}
+	}
+	LCD_wait_record(cls, polls * LCD_POLL_US);
+	return 1;
+}
+#endif
+
+void LCD_init(){
+	unsigned char r, c;
+	HAL_delay_ms(20); //power on time of the controller
+	LCD_bus_write(0, 0x38); //first function set, the busy flag can not be
+	HAL_delay_us(100); //checked before it, so it is always followed by a delay
+	LCD_send_command(0x38); //LCD initialization with 2 lines and 5*7 matrix
+	LCD_send_command(0x0E); //display on, cursor blinking
+	LCD_send_command(0x01); //clear LCD screen
+	for(r = 0; r < LCD_ROWS; r++){
+		for(c = 0; c < LCD_COLS; c++){
+			LCD_frame[r][c] = ' '; //controller shows blank screen after clear
+		}
+		LCD_dirty[r] = 0;
+	}
+	LCD_row = 0;
+	LCD_col = 0;
+	LCD_cursor = 0x00; //clear command returns the cursor home
+}
+
+void LCD_send_command(unsigned char cmnd){
+	//blocking command transfer, only used before the timer tick is running
+	unsigned char cls = LCD_cmd_class(cmnd);
+	LCD_bus_write(0, cmnd);
+#if LCD_BUSY_FLAG
+	LCD_wait_ready(cls, LCD_POLL_LIMIT); //return as soon as the command is done
+#else
+	if(cls == LCD_WAIT_CLEAR){
+		HAL_delay_ms(2); //clear and home take 1.52 ms
+		LCD_wait_record(cls, 2000);
+	}
+	else{
+		HAL_delay_us(100); //wait for 100 microseconds
+		LCD_wait_record(cls, 100);
+	}
+#endif
+}
+
+void LCD_send_data(unsigned char data){
+	//blocking data transfer, only used before the timer tick is running
+	LCD_bus_write(1, data);
+#if LCD_BUSY_FLAG
+	LCD_wait_ready(LCD_WAIT_DATA, LCD_POLL_LIMIT);
+#else
+	HAL_delay_us(100); //wait for 100 microseconds
+	LCD_wait_record(LCD_WAIT_DATA, 100);
+#endif
+}
+
+void LCD_goto(unsigned char row, unsigned char col){
+	//move the framebuffer cursor, row is 0 or 1, col is 0 to 15
+	LCD_row = row;
+	LCD_col = col;
+}
+
+void LCD_put(char c){
+	//write one character into the framebuffer at the cursor position and
+	//advance the cursor, characters beyond the end of the row are dropped
+	LCD_written++;
+	if(LCD_row >= LCD_ROWS || LCD_col >= LCD_COLS){
+		return;
+	}
+	if(LCD_frame[LCD_row][LCD_col] != c){
+		LCD_frame[LCD_row][LCD_col] = c;
+		HAL_ATOMIC{
+			LCD_dirty[LCD_row] |= (1U << LCD_col); //cell has to be flushed
+		}
+	}
+	LCD_col++;
+}
+
+void LCD_print(const char* str){
+	while(*str != 0){ //wait while string pointer goes to the string end
+		LCD_put(*str++); //write a char and increment a pointer
+	}
+}
+
+void LCD_print_P(const char* str){
+	//string in flash (HAL_PSTR)
+	char c;
+	while((c = HAL_flash_byte(str++)) != 0){
+		LCD_put(c);
+	}
+}
+
+static unsigned char LCD_flush_one(void){
+	//make one transfer for the next changed cell, returns the wait class of
+	//the transfer or LCD_WAIT_CLASSES if idle
+	unsigned char i, cell, row = 0, col = 0, addr;
+	if(LCD_dirty[0] == 0 && LCD_dirty[1] == 0){
+		return LCD_WAIT_CLASSES; //nothing changed
+	}
+	cell = (LCD_cursor & 0x40) ? LCD_COLS : 0; //cell index of the cursor
+	cell += LCD_cursor & 0x0F;
+	for(i = 0; i < LCD_ROWS * LCD_COLS; i++, cell++){
+		cell %= LCD_ROWS * LCD_COLS;
+		row = cell / LCD_COLS;
+		col = cell % LCD_COLS;
+		if(LCD_dirty[row] & (1U << col)){
+			break; //first changed cell after the cursor
+		}
+	}
+	addr = (row ? 0x40 : 0x00) + col;
+	LCD_flushed++;
+	if(addr != LCD_cursor){
+		LCD_bus_write(0, 0x80 | addr); //force cursor to the changed cell
+		LCD_cursor = addr;
+		return LCD_WAIT_CMD;
+	}
+	LCD_dirty[row] &= ~(1U << col);
+	TRACE_lcd(row * LCD_COLS + col, LCD_frame[row][col]);
+	LCD_bus_write(1, LCD_frame[row][col]); //send the character
+	LCD_cursor = (col == LCD_COLS - 1) ? 0xFF : addr + 1; //cursor auto increment
+	return LCD_WAIT_DATA;
+}
+
+void LCD_flush(void){
+	
+	//LCD_flush() is called from the timer tick interrupt every millisecond,
+	//cells are searched starting at the controller cursor, so a changed run of
+	//characters is sent without repeating the set DDRAM address command
+	//with the busy flag up to LCD_FLUSH_BURST transfers are made per tick, each
+	//one as soon as the controller has finished the previous one, with fixed
+	//delays only one transfer is made, the tick itself is the execution delay
+	
+#if LCD_BUSY_FLAG
+	unsigned char n, cls = LCD_WAIT_CLASSES;
+	for(n = 0; n < LCD_FLUSH_BURST; n++){
+		if(n > 0 && !LCD_wait_ready(cls, LCD_BURST_POLLS)){
+			break; //controller is still busy, continue on the next tick
+		}
+		cls = LCD_flush_one();
+		if(cls == LCD_WAIT_CLASSES){
+			break; //framebuffer is flushed
+		}
+	}
+#else
+	LCD_flush_one();
+#endif
+}
+
+unsigned char LCD_idle(void){
+	//true if the controller shows the whole framebuffer
+	unsigned char r;
+	for(r = 0; r < LCD_ROWS; r++){
+		if(LCD_dirty[r] != 0){
+			return 0;
+		}
+	}
+	return 1;
+}
+
+void LCD_stats(unsigned long* written, unsigned long* flushed){
+	//bytes written by the UI into the framebuffer compared with bytes really
+	//sent to the controller
+	HAL_ATOMIC{
+		*written = LCD_written;
+		*flushed = LCD_flushed;
+	}
+}
+
+void LCD_wait_stats(unsigned char cls, struct LCD_wait_stat* stat){
+	//copy of the wait statistics of one command class, used to compare the
+	//busy flag and the fixed delay builds on a real panel
+	HAL_ATOMIC{
+		*stat = LCD_waits[cls];
+	}
+}
@@ -0,0 +1,38 @@
+#ifndef LCD_H
+#define LCD_H
+
+//HD44780 2x16 LCD driver with a shadow framebuffer
+//the UI never talks to the LCD directly, it writes characters into LCD_frame
+//through LCD_goto(), LCD_print(), LCD_print_P() and LCD_put(), every changed cell is marked
+//in the dirty bitmap and LCD_flush() (called from the 1 ms timer tick) sends
+//the changed cells to the controller
+
+#define LCD_ROWS 2
+#define LCD_COLS 16
+
+//wait statistics classes, data write, ordinary command and clear/home command
+#define LCD_WAIT_DATA 0
+#define LCD_WAIT_CMD 1
+#define LCD_WAIT_CLEAR 2
+#define LCD_WAIT_CLASSES 3
+
+//time spent waiting for the controller after each transfer, in microseconds
+struct LCD_wait_stat{
+	unsigned int count; //number of waits
+	unsigned int max; //longest wait
+	unsigned long total; //sum of all waits
+};
+
+void LCD_init(void);
+void LCD_send_command(unsigned char cmnd);
+void LCD_send_data(unsigned char data);
+void LCD_goto(unsigned char row, unsigned char col);
+void LCD_put(char c);
+void LCD_print(const char* str);
+void LCD_print_P(const char* str);
+void LCD_flush(void);
+unsigned char LCD_idle(void);
+void LCD_stats(unsigned long* written, unsigned long* flushed);
+void LCD_wait_stats(unsigned char cls, struct LCD_wait_stat* stat);
+
+#endif
@@ -0,0 +1,115 @@
+//included libraries
+#include "config.h"
+#include "hal.h"
+#include "sched.h"
+#include "tick.h"
+
+struct SCHED_entry{
+	SCHED_task task;
+	unsigned char arg;
+};
+
+static volatile unsigned char SCHED_flags; //raised signals, one bit each
+static volatile unsigned long SCHED_raised[SCHED_SIGNALS]; //TICK_us() of the raise
+static SCHED_task SCHED_handlers[SCHED_SIGNALS];
+static struct SCHED_stat SCHED_stats[SCHED_SIGNALS];
+
+//task queue, filled by SCHED_post() from the main loop or from interrupts
+static volatile struct SCHED_entry SCHED_queue[SCHED_QUEUE];
+static volatile unsigned char SCHED_head, SCHED_tail;
+
+void SCHED_init(void){
+	unsigned char i;
+	SCHED_flags = 0;
+	SCHED_head = 0;
+	SCHED_tail = 0;
+	for(i = 0; i < SCHED_SIGNALS; i++){
+		SCHED_handlers[i] = 0;
+		SCHED_stats[i].count = 0;
+		SCHED_stats[i].total = 0;
+		SCHED_stats[i].max = 0;
+	}
+}
+
+void SCHED_on(unsigned char signal, SCHED_task handler){
+	SCHED_handlers[signal] = handler;
+}
+
+void SCHED_signal(unsigned char signal){
+	//raise a signal, called from interrupts, a signal raised again before its
+	//handler ran is handled once, latency is counted from the first raise
+	HAL_ATOMIC{
+		if((SCHED_flags & (1 << signal)) == 0){
+			SCHED_flags |= (1 << signal);
+			SCHED_raised[signal] = TICK_us();
+		}
+	}
+}
+
+unsigned char SCHED_post(SCHED_task task, unsigned char arg){
+	//queue a task to run on the next SCHED_run(), returns 0 if the queue is full
+	unsigned char next, done = 0;
+	HAL_ATOMIC{
+		next = (SCHED_head + 1) & (SCHED_QUEUE - 1);
+		if(next != SCHED_tail){
+			SCHED_queue[SCHED_head].task = task;
+			SCHED_queue[SCHED_head].arg = arg;
+			SCHED_head = next;
+			done = 1;
+		}
+	}
+	return done;
+}
+
+static void SCHED_record(unsigned char signal, unsigned long raised){
+	struct SCHED_stat* stat = &SCHED_stats[signal];
+	unsigned long latency = TICK_us() - raised;
+	stat->count++;
+	stat->total += latency;
+	if(latency > stat->max){
+		stat->max = latency > 0xFFFF ? 0xFFFF : latency;
+	}
+}
+
+void SCHED_run(void){
+	
+	//SCHED_run() is one pass of the event dispatch loop, every handler and task
+	//runs to completion, so the latency of a signal is bounded by the longest
+	//handler or task, not by any delay
+	
+	unsigned char flags, i;
+	unsigned long raised = 0;
+	SCHED_task task;
+	HAL_ATOMIC{
+		flags = SCHED_flags;
+		SCHED_flags = 0;
+	}
+	for(i = 0; i < SCHED_SIGNALS; i++){
+		if(flags & (1 << i)){
+			HAL_ATOMIC{
+				raised = SCHED_raised[i];
+			}
+			if(SCHED_handlers[i] != 0){
+				SCHED_handlers[i](i);
+			}
+			SCHED_record(i, raised);
+		}
+	}
+	while(SCHED_tail != SCHED_head){
+		task = SCHED_queue[SCHED_tail].task;
+		i = SCHED_queue[SCHED_tail].arg;
+		SCHED_tail = (SCHED_tail + 1) & (SCHED_QUEUE - 1);
+		task(i);
+	}
+}
+
+unsigned char SCHED_pending(void){
+	//true if a signal is raised or a task is queued, called with interrupts
+	//disabled before the main loop sleeps, so nothing can be raised between
+	//the check and the sleep
+	return SCHED_flags != 0 || SCHED_head != SCHED_tail;
+}
+
+void SCHED_latency(unsigned char signal, struct SCHED_stat* stat){
+	*stat = SCHED_stats[signal];
+}
@@ -0,0 +1,34 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+//cooperative run-to-completion scheduler
+//interrupts raise signals (a bit each, cheap and never lost), the main loop
+//calls SCHED_run() which runs the handler of every raised signal, then the
+//posted tasks, no handler or task may wait, anything which takes time is
+//split into tasks started by software timers (timer.h)
+//the time from raising a signal to the end of its handler is measured, it is
+//the input-to-reaction latency of the system
+
+//signals
+#define SCHED_KEY 0 //keypad event queued
+#define SCHED_TIMER 1 //software timers are armed, a tick passed
+#define SCHED_RX 2 //byte received from the GSM module
+#define SCHED_SIGNALS 3
+
+typedef void (*SCHED_task)(unsigned char arg);
+
+struct SCHED_stat{
+	unsigned long count; //handled signals
+	unsigned long total; //sum of latencies in microseconds
+	unsigned int max; //longest latency in microseconds
+};
+
+void SCHED_init(void);
+void SCHED_on(unsigned char signal, SCHED_task handler);
+void SCHED_signal(unsigned char signal);
+unsigned char SCHED_post(SCHED_task task, unsigned char arg);
+void SCHED_run(void);
+unsigned char SCHED_pending(void);
+void SCHED_latency(unsigned char signal, struct SCHED_stat* stat);
+
+#endif
@@ -0,0 +1,66 @@
+//included libraries
+#include "config.h"
+#include "hal.h"
+#include "sleep.h"
+#include "sched.h"
+#include "timer.h"
+#include "keypad.h"
+#include "lcd.h"
+#include "uart.h"
+#include "eeprom.h"
+
+#if SLEEP_MODE < 0 || SLEEP_MODE > 2
+#error "SLEEP_MODE is 0 (no sleep), 1 (idle) or 2 (idle and power-down)"
+#endif
+
+static struct TIMER SLEEP_timer; //armed after a wake-up from power-down
+
+static void SLEEP_awake(unsigned char arg){
+	//SLEEP_AWAKE_MS after the wake-up, power-down is allowed again
+}
+
+static void SLEEP_woke(unsigned char arg){
+	//the armed timer keeps the lock out of power-down
+	TIMER_start(&SLEEP_timer, SLEEP_AWAKE_MS, 0);
+}
+
+void SLEEP_init(void){
+	TIMER_setup(&SLEEP_timer, SLEEP_awake, 0);
+}
+
+void SLEEP_busy(void){
+	//a byte was received, more of the line follows
+#if SLEEP_MODE == 2
+	TIMER_start(&SLEEP_timer, SLEEP_AWAKE_MS, 0);
+#endif
+}
+
+void SLEEP_isr(void){
+	//INT0, a key or the modem woke the CPU from power-down
+	SCHED_post(SLEEP_woke, 0);
+}
+
+#if SLEEP_MODE == 2
+static unsigned char SLEEP_quiet(void){
+	//nothing needs the clocks, the lock can wait for a key in power-down
+	return KEYPAD_idle() && LCD_idle() && UART_tx_idle() && EEPROM_pending() == 0
+		&& !HAL_eeprom_busy() && !TIMER_active();
+}
+#endif
+
+void SLEEP_enter(void){
+#if SLEEP_MODE != 0
+	unsigned char mode = HAL_SLEEP_IDLE;
+	HAL_irq_disable();
+	if(SCHED_pending()){
+		HAL_irq_enable(); //an interrupt raised work after SCHED_run()
+		return;
+	}
+#if SLEEP_MODE == 2
+	if(SLEEP_quiet()){
+		mode = HAL_SLEEP_DOWN;
+	}
+#endif
+	HAL_sleep(mode); //returns with interrupts enabled
+#endif
+}
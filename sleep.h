@@ -0,0 +1,23 @@
+#ifndef SLEEP_H
+#define SLEEP_H
+
+//low power main loop
+//SLEEP_enter() is called by the main loop after every SCHED_run(), if no
+//signal is raised and no task is queued the CPU sleeps until the next
+//interrupt, in idle mode the 1 ms tick keeps scanning the keypad and the
+//UART and EEPROM interrupts keep running, so nothing changes for the
+//drivers, with SLEEP_MODE 2 the CPU enters power-down instead while there
+//is nothing the clocks are needed for: every key released and debounced,
+//LCD and EEPROM written, UART transmitter done and no software timer armed
+//(no lockout, alarm, modem command or alert), a key or a byte on RXD wakes
+//it through INT0, SLEEP_isr() then keeps the lock awake for SLEEP_AWAKE_MS
+//so the key is scanned, SLEEP_busy() does the same for every received byte,
+//so a line is received whole, the byte which woke the CPU is lost, modem
+//answers and URCs start with "\r\n", the 1 ms clock does not count the time
+//spent in power-down
+
+void SLEEP_init(void);
+void SLEEP_enter(void);
+void SLEEP_busy(void);
+
+#endif
@@ -0,0 +1,307 @@
+//included libraries
+#include "config.h"
+#include <string.h>
+#include "hal.h"
+#include "sms.h"
+#include "gsm.h"
+#include "cred.h"
+
+static const char SMS_contact[] HAL_FLASH = CONTACT_NUMBER;
+
+static SMS_command_fn SMS_handler;
+static unsigned char SMS_listing; //AT+CMGL queued or in progress
+static unsigned char SMS_again; //+CMTI during the listing
+static unsigned char SMS_body; //next line is the text of a message
+static unsigned char SMS_trusted; //sender of that message is the contact
+static char SMS_cmgs[SMS_CMGS]; //command of the answer
+static char SMS_text[SMS_TEXT + 2]; //answer, Ctrl-Z and 0
+static unsigned char SMS_len; //answer length
+static unsigned char SMS_busy; //answer queued
+static unsigned char SMS_skip; //no answer, the buffer is still queued
+
+void SMS_init(SMS_command_fn handler){
+	SMS_handler = handler;
+	SMS_listing = 0;
+	SMS_again = 0;
+	SMS_body = 0;
+	SMS_busy = 0;
+	SMS_skip = 0;
+}
+
+static unsigned char SMS_field(const char* line, unsigned char len, unsigned char n,
+	struct SMS_slice* field){
+	
+	//SMS_field() finds field n of a comma separated answer, commas in quotes
+	//do not count, the quotes are not part of the slice, returns 0 if the line
+	//has fewer fields
+	
+	unsigned char i = 0, quoted = 0, start = 0;
+	for(;; i++){
+		if(i == len || (line[i] == ',' && !quoted)){
+			if(n-- == 0){
+				if(i - start >= 2 && line[start] == '"' && line[i - 1] == '"'){
+					start++;
+					i--;
+				}
+				field->text = line + start;
+				field->len = i - start;
+				return 1;
+			}
+			if(i == len){
+				return 0;
+			}
+			start = i + 1;
+		}
+		else if(line[i] == '"'){
+			quoted ^= 1;
+		}
+	}
+}
+
+static unsigned char SMS_word(const char** p, const char* end, struct SMS_slice* word){
+	//next word separated by spaces, returns 0 at the end of the line
+	while(*p < end && **p == ' '){
+		(*p)++;
+	}
+	word->text = *p;
+	while(*p < end && **p != ' '){
+		(*p)++;
+	}
+	word->len = *p - word->text;
+	return word->len != 0;
+}
+
+static unsigned char SMS_is(const struct SMS_slice* word, const char* keyword){
+	//word equals a flash keyword, lower case letters of the word match too
+	unsigned char i;
+	char c;
+	for(i = 0; i < word->len; i++){
+		c = word->text[i];
+		if(c >= 'a' && c <= 'z'){
+			c -= 'a' - 'A';
+		}
+		if(c != (char)HAL_flash_byte(keyword + i)){
+			return 0;
+		}
+	}
+	return HAL_flash_byte(keyword + i) == 0;
+}
+
+static unsigned char SMS_from_contact(const struct SMS_slice* sender){
+	
+	//SMS_from_contact() compares the national number (CONTACT_NUMBER without
+	//the leading 0) with the end of the sender, so "+95998742925" and
+	//"0998742925" are both the contact
+	
+	const char* contact = SMS_contact;
+	unsigned char n = 0, i;
+	while(HAL_flash_byte(contact) == '0'){
+		contact++;
+	}
+	while(HAL_flash_byte(contact + n) != 0){
+		n++;
+	}
+	if(n == 0 || sender->len < n){
+		return 0;
+	}
+	for(i = 0; i < n; i++){
+		if(sender->text[sender->len - n + i] != (char)HAL_flash_byte(contact + i)){
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static void SMS_command(const char* line, unsigned char len){
+	
+	//SMS_command() checks the master PIN in the first word in constant time
+	//(CRED_find) and passes the command in the second word to the handler
+	
+	const char* p = line;
+	struct SMS_slice pin, word, arg;
+	char digits[PIN_LENGTH];
+	unsigned char i, command = SMS_DENIED;
+	if(SMS_word(&p, line + len, &pin) && pin.len == PIN_LENGTH){
+		for(i = 0; i < PIN_LENGTH; i++){
+			digits[i] = pin.text[i] - '0'; //not a digit if it is above 9
+		}
+		if(CRED_find(digits) == 0 && SMS_word(&p, line + len, &word)){
+			if(SMS_is(&word, HAL_PSTR("STATUS"))){
+				command = SMS_STATUS;
+			}
+			else if(SMS_is(&word, HAL_PSTR("UNBLOCK"))){
+				command = SMS_UNBLOCK;
+			}
+			else if(SMS_is(&word, HAL_PSTR("PIN"))){
+				command = SMS_PIN;
+			}
+			else if(SMS_is(&word, HAL_PSTR("LOG"))){
+				command = SMS_LOG;
+			}
+		}
+	}
+	if(!SMS_word(&p, line + len, &arg)){
+		arg.len = 0;
+	}
+	SMS_handler(command, &arg);
+}
+
+static void SMS_listed(unsigned char result);
+
+static void SMS_list(void){
+	SMS_listing = GSM_queue(HAL_PSTR("AT+CMGL=\"REC UNREAD\"\r"), GSM_OK, 5000, 1,
+		GSM_FLASH, SMS_listed);
+}
+
+static void SMS_deleted(unsigned char result){
+	//listing and deletion are over, a message which came in meanwhile is
+	//listed next
+	SMS_listing = 0;
+	if(SMS_again){
+		SMS_again = 0;
+		SMS_list();
+	}
+}
+
+static void SMS_listed(unsigned char result){
+	//listing done, the read messages are deleted, until then the lines still
+	//belong to the SMS channel
+	SMS_body = 0;
+	if(!GSM_queue(HAL_PSTR("AT+CMGD=1,1\r"), GSM_OK, 5000, 1, GSM_FLASH, SMS_deleted)){
+		SMS_deleted(0);
+	}
+}
+
+static void SMS_message(const char* line, unsigned char len){
+	//lines of a message text, the first one is the command
+	if(SMS_body){
+		SMS_body = 0;
+		if(SMS_trusted){
+			SMS_command(line, len);
+		}
+	}
+}
+
+static unsigned int SMS_length(const struct SMS_slice* field){
+	//decimal text length of a +CMGL header, 0 if it is not a number
+	unsigned int n = 0;
+	unsigned char i;
+	for(i = 0; i < field->len; i++){
+		if(field->text[i] < '0' || field->text[i] > '9' || n > 999){
+			return 0;
+		}
+		n = n * 10 + field->text[i] - '0';
+	}
+	return n;
+}
+
+unsigned char SMS_line(const char* line, unsigned char len){
+	
+	//SMS_line() is called with every line the GSM engine does not consume,
+	//returns 1 if the line belongs to the SMS channel
+	
+	struct SMS_slice sender, length;
+	unsigned int n;
+	if(len >= 6 && memcmp(line, "+CMTI:", 6) == 0){
+		if(SMS_listing){
+			SMS_again = 1;
+		}
+		else{
+			SMS_list();
+		}
+		return 1;
+	}
+	if(!SMS_listing){
+		return 0;
+	}
+	if(len >= 7 && memcmp(line, "+CMGL: ", 7) == 0){
+		
+		//the header carries the text length (AT+CSDH=1), the text is taken
+		//as data, whatever lines it has, a header without it is not trusted
+		
+		n = SMS_field(line + 7, len - 7, 6, &length) ? SMS_length(&length) : 0;
+		SMS_body = n != 0;
+		SMS_trusted = n != 0 && SMS_field(line + 7, len - 7, 2, &sender) && SMS_from_contact(&sender);
+		if(n != 0){
+			GSM_data(n, SMS_message);
+		}
+	}
+	return 1; //other lines of the listing
+}
+
+static unsigned char SMS_queue(char* cmgs, const char* number, unsigned char flash,
+	const char* text, unsigned char flags, GSM_done_fn done){
+	
+	//SMS_queue() writes AT+CMGS="number" into the command buffer, number is
+	//in flash or in RAM, and queues the command and the text, both or none,
+	//an AT+CMGS without its text would leave the modem at the prompt and the
+	//next command would be typed into the message
+	
+	unsigned char i = 0;
+	char c;
+	if(GSM_free() < 2){
+		return 0;
+	}
+	while((c = HAL_flash_byte(HAL_PSTR("AT+CMGS=\"") + i)) != 0){
+		cmgs[i++] = c;
+	}
+	while(i < SMS_CMGS - 3 && (c = flash ? HAL_flash_byte(number) : *number) != 0){
+		cmgs[i++] = c;
+		number++;
+	}
+	cmgs[i++] = '"';
+	cmgs[i++] = '\r';
+	cmgs[i] = 0;
+	GSM_queue(cmgs, GSM_PROMPT, 5000, 1, 0, 0); //command to send SMS
+	return GSM_queue(text, GSM_OK, 60000, 0, GSM_CHAINED | flags, done);
+}
+
+unsigned char SMS_send(char* cmgs, const char* number, const char* text, unsigned char flags,
+	GSM_done_fn done){
+	
+	//SMS_send() queues a message to number, text ends with Ctrl-Z, the
+	//command buffer (SMS_CMGS bytes) and text have to stay valid until done
+	//is called, returns 0 if the AT command queue has no room
+	
+	return SMS_queue(cmgs, number, 0, text, flags, done);
+}
+
+void SMS_reply_begin(void){
+	//start an answer, while the previous answer is still queued the new one
+	//is dropped
+	SMS_skip = SMS_busy;
+	SMS_len = SMS_skip ? SMS_TEXT : 0;
+}
+
+void SMS_reply_P(const char* text){
+	char c;
+	while((c = HAL_flash_byte(text++)) != 0 && SMS_len < SMS_TEXT){
+		SMS_text[SMS_len++] = c;
+	}
+}
+
+void SMS_reply_number(unsigned long n){
+	char digits[10];
+	unsigned char i = 0;
+	do{
+		digits[i++] = '0' + n % 10;
+		n /= 10;
+	}
+	while(n != 0);
+	while(i > 0 && SMS_len < SMS_TEXT){
+		SMS_text[SMS_len++] = digits[--i];
+	}
+}
+
+static void SMS_replied(unsigned char result){
+	SMS_busy = 0; //answer buffer is free again
+}
+
+void SMS_reply_send(void){
+	if(SMS_skip){
+		return;
+	}
+	SMS_text[SMS_len] = 0x1A; //end of text, send SMS
+	SMS_text[SMS_len + 1] = 0;
+	SMS_busy = SMS_queue(SMS_cmgs, SMS_contact, 1, SMS_text, 0, SMS_replied);
+}
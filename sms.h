@@ -0,0 +1,52 @@
+#ifndef SMS_H
+#define SMS_H
+
+#include "gsm.h"
+
+//SMS command channel
+//the modem reports a new message with "+CMTI: ...", SMS_line() then queues
+//AT+CMGL="REC UNREAD", which lists every unread message as a header line
+//"+CMGL: index,status,sender,...,length" (AT+CSDH=1) and the text, both are
+//parsed in the line buffer of the GSM engine without copying, fields and
+//words are slices (pointer and length) into the line, the text is taken as
+//length bytes of data (GSM_data()), so none of its lines can end the listing
+//or reach another handler, a message is a command if the sender ends with the
+//national number of CONTACT_NUMBER and the first line of the text starts
+//with the master PIN, e.g. "1234 STATUS", the read messages are deleted after
+//the listing, from the +CMTI until the deletion is answered every line
+//belongs to the SMS channel and never reaches the service port handlers
+//commands: STATUS, UNBLOCK, PIN dddd (new master PIN), LOG
+//an answer is built with SMS_reply_begin(), SMS_reply_P() and
+//SMS_reply_number() and sent to CONTACT_NUMBER by SMS_reply_send(), there is
+//one answer buffer, a command arriving while an answer is still queued is
+//carried out without an answer
+//SMS_send() sends a message to any number, every sender which can have a
+//message queued owns a command buffer of SMS_CMGS bytes for it
+
+#define SMS_STATUS 0
+#define SMS_UNBLOCK 1
+#define SMS_PIN 2
+#define SMS_LOG 3
+#define SMS_DENIED 4 //from the contact number, wrong PIN or unknown command
+
+#define SMS_NUMBER 16 //longest phone number and its 0
+#define SMS_CMGS (SMS_NUMBER + 11) //AT+CMGS="number"\r and 0
+
+struct SMS_slice{
+	const char* text; //into the line, valid during the call
+	unsigned char len;
+};
+
+//command handler, arg is the word after the command (len 0 if there is none)
+typedef void (*SMS_command_fn)(unsigned char command, const struct SMS_slice* arg);
+
+void SMS_init(SMS_command_fn handler);
+unsigned char SMS_line(const char* line, unsigned char len);
+unsigned char SMS_send(char* cmgs, const char* number, const char* text, unsigned char flags,
+	GSM_done_fn done);
+void SMS_reply_begin(void);
+void SMS_reply_P(const char* text);
+void SMS_reply_number(unsigned long n);
+void SMS_reply_send(void);
+
+#endif
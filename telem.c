@@ -0,0 +1,94 @@
+//included libraries
+#include "config.h"
+#include <string.h>
+#include "hal.h"
+#include "telem.h"
+#include "frame.h"
+#include "keypad.h"
+#include "uart.h"
+#include "lcd.h"
+#include "sched.h"
+#include "journal.h"
+
+#if TELEM
+
+//every channel is written from one context only (tick interrupt or main
+//loop), so TELEM_record() needs no atomic block
+static struct TELEM_channel TELEM_channels[TELEM_CHANNELS];
+
+void TELEM_init(void){
+	unsigned char i;
+	for(i = 0; i < TELEM_CHANNELS; i++){
+		TELEM_channels[i].count = 0;
+		TELEM_channels[i].min = 0xFFFF;
+		TELEM_channels[i].max = 0;
+		TELEM_channels[i].sum = 0;
+	}
+}
+
+void TELEM_record(unsigned char channel, unsigned int value){
+	struct TELEM_channel* ch = &TELEM_channels[channel];
+	if(ch->count == 0xFFFF){
+		return; //full, keep the mean of what was counted
+	}
+	ch->count++;
+	ch->sum += value;
+	if(value < ch->min){
+		ch->min = value;
+	}
+	if(value > ch->max){
+		ch->max = value;
+	}
+}
+
+void TELEM_send(void){
+	
+	//TELEM_send() sends the telemetry frame, every channel is copied with
+	//interrupts disabled, so the tick can not update it halfway
+	
+	struct TELEM_channel ch;
+	struct LCD_wait_stat wait;
+	struct SCHED_stat latency;
+	unsigned long written, flushed;
+	unsigned char i;
+	FRAME_begin(FRAME_TELEM, 9 + TELEM_CHANNELS * 10 + 9 + LCD_WAIT_CLASSES * 8
+		+ 1 + SCHED_SIGNALS * 10 + 2);
+	FRAME_long(TICK_now());
+	FRAME_word(KEYPAD_dropped());
+	FRAME_word(UART_rx_lost());
+	FRAME_byte(TELEM_CHANNELS);
+	for(i = 0; i < TELEM_CHANNELS; i++){
+		HAL_ATOMIC{
+			ch = TELEM_channels[i];
+		}
+		FRAME_word(ch.count);
+		FRAME_word(ch.count ? ch.min : 0);
+		FRAME_word(ch.max);
+		FRAME_long(ch.sum);
+	}
+	LCD_stats(&written, &flushed);
+	FRAME_long(written);
+	FRAME_long(flushed);
+	FRAME_byte(LCD_WAIT_CLASSES);
+	for(i = 0; i < LCD_WAIT_CLASSES; i++){
+		LCD_wait_stats(i, &wait);
+		FRAME_word(wait.count);
+		FRAME_word(wait.max);
+		FRAME_long(wait.total);
+	}
+	FRAME_byte(SCHED_SIGNALS);
+	for(i = 0; i < SCHED_SIGNALS; i++){
+		SCHED_latency(i, &latency);
+		FRAME_long(latency.count);
+		FRAME_long(latency.total);
+		FRAME_word(latency.max);
+	}
+	FRAME_word(JOURNAL_writes());
+	FRAME_end();
+}
+
+unsigned char TELEM_requested(const char* line, unsigned char len){
+	return len == 6 && memcmp(line, "#TELEM", 6) == 0;
+}
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef TELEM_H
+#define TELEM_H
+
+//telemetry counters
+//hooks on the key paths keep count, minimum, maximum and sum of a duration
+//per channel, short paths are measured in microseconds with TICK_stamp(),
+//the lockout in seconds and the alert SMS in milliseconds, TELEM_send() sends
+//all channels as one binary frame (frame.h) on the service port, with TELEM
+//set to 0 in config.h the hooks compile to nothing
+//frame FRAME_TELEM payload: uptime ms (4), keys dropped (2), UART bytes lost
+//(2), channel count (1), then per channel count (2), min (2), max (2), sum (4),
+//then the LCD counters of the UI bytes written into the framebuffer (4) and
+//of the bytes sent to the controller (4), LCD wait class count (1), then per
+//class (data, command, clear) waits (2), longest (2) and total (4) in us,
+//scheduler signal count (1), then per signal (key, timer, receive) handled
+//signals (4), total (4) and longest (2) latency in us, then the lock state
+//journal records written since the boot (2)
+//the frame is requested with the line "#TELEM" on the service port
+
+#define TELEM_SCAN 0 //KEYPAD_scan() in the tick, us
+#define TELEM_DISPATCH 1 //run_key_function(), us
+#define TELEM_LCD 2 //LCD_flush() in the tick, us
+#define TELEM_EEPROM 3 //EEPROM_write() with the wait for a free slot, us
+#define TELEM_COMMIT 4 //EEPROM_commit() waiting for the queue to drain, ms
+#define TELEM_UART 5 //UART_send_char() with the wait for a free slot, us
+#define TELEM_LOCKOUT 6 //lockout from three strikes to ready, s
+#define TELEM_SMS 7 //alert SMS to one recipient, queued to the modem answer, ms
+#define TELEM_CHANNELS 8
+
+struct TELEM_channel{
+	unsigned int count; //stops at 0xFFFF, the mean stays right
+	unsigned int min;
+	unsigned int max;
+	unsigned long sum;
+};
+
+#if TELEM
+#include "tick.h"
+#define TELEM_BEGIN(t) unsigned int t = TICK_stamp()
+#define TELEM_END(channel, t) TELEM_record(channel, TICK_stamp() - (t))
+void TELEM_init(void);
+void TELEM_record(unsigned char channel, unsigned int value);
+void TELEM_send(void);
+unsigned char TELEM_requested(const char* line, unsigned char len);
+#else
+#define TELEM_BEGIN(t)
+#define TELEM_END(channel, t)
+#define TELEM_init()
+#define TELEM_record(channel, value)
+#define TELEM_send()
+#define TELEM_requested(line, len) 0
+#endif
+
+#endif
@@ -0,0 +1,92 @@
+//included libraries
+#include "config.h"
+#include "hal.h"
+#include "tick.h"
+#include "bench.h"
+#include "telem.h"
+#include "keypad.h"
+#include "lcd.h"
+#include "sched.h"
+#include "timer.h"
+#include "trace.h"
+
+static volatile unsigned long TICK_ms; //milliseconds since reset
+
+void TICK_init(){
+	//Timer1 is the 1 ms system tick, CTC mode (WGM12) with clk/8 prescale
+	//(CS11), compare match interrupt flushes the LCD framebuffer, scans the
+	//keypad matrix and drives the software timers
+	TICK_ms = 0;
+	HAL_tick_init();
+}
+
+unsigned long TICK_now(void){
+	//32 bit counter is read with interrupts disabled, so it can not change
+	//between the byte reads
+	unsigned long now;
+	HAL_ATOMIC{
+		now = TICK_ms;
+	}
+	return now;
+}
+
+unsigned long TICK_us(void){
+	//microseconds since reset, Timer1 counts microseconds between the ticks,
+	//a compare match which is pending while interrupts are disabled is counted
+	//as well, the value wraps after about 71 minutes, so only differences of
+	//two readings are meaningful
+	unsigned long ms;
+	unsigned int count;
+	HAL_ATOMIC{
+		ms = TICK_ms;
+		count = HAL_tick_elapsed();
+	}
+	return ms * 1000 + count;
+}
+
+unsigned int TICK_stamp(void){
+	//16 bit microsecond time stamp for short durations, differences are right
+	//up to 65 ms, cheaper than TICK_us() as it needs no 32 bit multiply
+	unsigned int ms, count;
+	HAL_ATOMIC{
+		ms = (unsigned int)TICK_ms;
+		count = HAL_tick_elapsed();
+	}
+	return ms * 1000 + count;
+}
+
+void TICK_skip(unsigned long ms){
+	//move the clock forward without the tick work, only allowed while the
+	//keypad and the LCD are idle, the software timers catch up on the next
+	//tick, so ms has to end before the next timer is due (TIMER_next())
+	TRACE_tick();
+	KEYPAD_skip(ms);
+	HAL_ATOMIC{
+		TICK_ms += ms;
+	}
+}
+
+void TICK_isr(void){
+	unsigned char pushed;
+	TRACE_tick(); //outputs set in the millisecond which ends
+	TICK_ms++;
+	if(TIMER_active()){
+		SCHED_signal(SCHED_TIMER); //software timers have to be serviced
+	}
+	TELEM_BEGIN(scan);
+	pushed = KEYPAD_scan();
+	TELEM_END(TELEM_SCAN, scan);
+	if(pushed){
+		SCHED_signal(SCHED_KEY); //key pressed or released
+		BENCH_start(BENCH_KEY_LCD);
+		BENCH_start(BENCH_KEY_RELAY);
+	}
+	if(!LCD_idle()){
+		TELEM_BEGIN(flush);
+		LCD_flush(); //send changed cells to the LCD
+		TELEM_END(TELEM_LCD, flush);
+		if(LCD_idle()){
+			BENCH_stop(BENCH_KEY_LCD); //new frame is shown
+		}
+	}
+}
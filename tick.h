@@ -0,0 +1,18 @@
+#ifndef TICK_H
+#define TICK_H
+
+//1 ms system tick on Timer1, the compare match interrupt scans the keypad,
+//flushes the LCD framebuffer, counts milliseconds since reset and raises the
+//SCHED_TIMER signal while software timers are armed, Timer1 itself counts the
+//microseconds between the ticks
+
+void TICK_init(void);
+unsigned long TICK_now(void);
+unsigned long TICK_us(void);
+void TICK_skip(unsigned long ms);
+unsigned int TICK_stamp(void);
+
+//true if the millisecond time stamp t is not in the future, wrap safe
+#define TICK_reached(now, t) ((long)((now) - (t)) >= 0)
+
+#endif
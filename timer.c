@@ -0,0 +1,158 @@
+//included libraries
+#include "config.h"
+#include "hal.h"
+#include "timer.h"
+#include "tick.h"
+
+//wheel slots, the sentinel of each slot is a struct TIMER which is never armed
+static struct TIMER TIMER_wheel[TIMER_WHEEL];
+static unsigned long TIMER_tick; //last tick processed by TIMER_service()
+static volatile unsigned char TIMER_count; //armed timers
+
+void TIMER_init(void){
+	unsigned char i;
+	for(i = 0; i < TIMER_WHEEL; i++){
+		TIMER_wheel[i].next = &TIMER_wheel[i]; //empty circular list
+		TIMER_wheel[i].prev = &TIMER_wheel[i];
+	}
+	TIMER_tick = TICK_now();
+	TIMER_count = 0;
+}
+
+void TIMER_setup(struct TIMER* timer, SCHED_task task, unsigned char arg){
+	timer->task = task;
+	timer->arg = arg;
+	timer->armed = 0;
+}
+
+static void TIMER_insert(struct TIMER* timer, struct TIMER* slot){
+	HAL_ATOMIC{
+		timer->prev = slot->prev; //append at the slot end
+		timer->next = slot;
+		slot->prev->next = timer;
+		slot->prev = timer;
+	}
+}
+
+static void TIMER_link(struct TIMER* timer, unsigned long base, unsigned int ms){
+	//insert the timer into the slot of tick base + ms, slot of the due tick is
+	//visited (ms - 1) / TIMER_WHEEL times before the timer is due
+	if(ms == 0){
+		ms = 1; //earliest expiry is the next tick
+	}
+	timer->rounds = (ms - 1) / TIMER_WHEEL;
+	TIMER_insert(timer, &TIMER_wheel[(base + ms) & (TIMER_WHEEL - 1)]);
+}
+
+static void TIMER_unlink(struct TIMER* timer){
+	HAL_ATOMIC{
+		timer->prev->next = timer->next;
+		timer->next->prev = timer->prev;
+	}
+}
+
+void TIMER_start(struct TIMER* timer, unsigned int ms, unsigned int period){
+	
+	//arm a timer to expire after ms milliseconds and then every period ms,
+	//a timer which is already armed is restarted, with no timer armed the
+	//wheel is not serviced, so its position is moved to the current tick
+	
+	if(timer->armed){
+		TIMER_cancel(timer);
+	}
+	if(TIMER_count == 0){
+		TIMER_tick = TICK_now();
+	}
+	timer->period = period;
+	timer->armed = 1;
+	TIMER_link(timer, TIMER_tick, ms);
+	TIMER_count++;
+}
+
+void TIMER_cancel(struct TIMER* timer){
+	if(!timer->armed){
+		return;
+	}
+	TIMER_unlink(timer);
+	timer->armed = 0;
+	TIMER_count--;
+}
+
+unsigned char TIMER_active(void){
+	//true if any timer is armed, the tick interrupt raises SCHED_TIMER only then
+	return TIMER_count != 0;
+}
+
+unsigned long TIMER_next(void){
+	
+	//TIMER_next() returns the milliseconds from now until the earliest armed
+	//timer is due, 0 if no timer is armed, it walks every slot, so it is meant
+	//for idle decisions and not for the tick, a timer in slot i is due after
+	//the distance of the slot from the wheel position plus its wheel turns
+	
+	struct TIMER *slot, *timer;
+	unsigned long due, best = 0, behind;
+	unsigned char i;
+	if(TIMER_count == 0){
+		return 0;
+	}
+	for(i = 0; i < TIMER_WHEEL; i++){
+		slot = &TIMER_wheel[i];
+		for(timer = slot->next; timer != slot; timer = timer->next){
+			due = ((i - TIMER_tick - 1) & (TIMER_WHEEL - 1)) + 1
+				+ (unsigned long)timer->rounds * TIMER_WHEEL;
+			if(best == 0 || due < best){
+				best = due;
+			}
+		}
+	}
+	behind = TICK_now() - TIMER_tick; //ticks not serviced yet
+	return best > behind ? best - behind : 1;
+}
+
+void TIMER_service(unsigned char arg){
+	
+	//TIMER_service() processes every tick since the previous call, each tick
+	//visits one slot, the slot list is moved to a local list first, so the
+	//expired tasks may start or cancel any timer, also the ones still waiting
+	//in the local list, timers with wheel turns left go back into the slot
+	//periodic timers are re-armed from their due tick, so they do not drift
+	
+	struct TIMER pending, *timer, *slot;
+	unsigned long now = TICK_now();
+	while(TIMER_count != 0 && TIMER_tick != now){
+		TIMER_tick++;
+		slot = &TIMER_wheel[TIMER_tick & (TIMER_WHEEL - 1)];
+		if(slot->next == slot){
+			continue; //empty slot
+		}
+		HAL_ATOMIC{
+			pending.next = slot->next; //splice the slot into the local list
+			pending.prev = slot->prev;
+			pending.next->prev = &pending;
+			pending.prev->next = &pending;
+			slot->next = slot;
+			slot->prev = slot;
+		}
+		while(pending.next != &pending){
+			timer = pending.next;
+			TIMER_unlink(timer);
+			if(timer->rounds > 0){
+				timer->rounds--; //due on a later turn of the wheel
+				TIMER_insert(timer, slot);
+				continue;
+			}
+			if(timer->period != 0){
+				TIMER_link(timer, TIMER_tick, timer->period);
+			}
+			else{
+				timer->armed = 0;
+				TIMER_count--;
+			}
+			timer->task(timer->arg);
+		}
+	}
+	if(TIMER_count == 0){
+		TIMER_tick = now;
+	}
+}
@@ -0,0 +1,33 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include "sched.h"
+
+//software timers on the 1 ms system tick
+//timers live in a hashed timer wheel of TIMER_WHEEL slots, a timer due in ms
+//milliseconds goes into slot (tick + ms) % TIMER_WHEEL with the number of
+//whole wheel turns it has to wait, every slot is a circular doubly linked
+//list with a sentinel, so starting, cancelling and expiring a timer are O(1)
+//and every tick visits only one slot, TIMER_service() is the handler of the
+//SCHED_TIMER signal and runs the expired tasks in the main loop
+//the struct TIMER is owned by the caller and has to stay valid while armed
+
+struct TIMER{
+	struct TIMER* next;
+	struct TIMER* prev;
+	SCHED_task task; //called when the timer expires
+	unsigned int period; //re-arm interval in ms, 0 for a one-shot timer
+	unsigned int rounds; //wheel turns left before the timer is due
+	unsigned char arg; //argument of the task
+	unsigned char armed;
+};
+
+void TIMER_init(void);
+void TIMER_setup(struct TIMER* timer, SCHED_task task, unsigned char arg);
+void TIMER_start(struct TIMER* timer, unsigned int ms, unsigned int period);
+void TIMER_cancel(struct TIMER* timer);
+unsigned char TIMER_active(void);
+unsigned long TIMER_next(void);
+void TIMER_service(unsigned char arg);
+
+#endif
@@ -0,0 +1,223 @@
+//included libraries
+#include "config.h"
+#include <string.h>
+#include "hal.h"
+#include "trace.h"
+#include "frame.h"
+#include "tick.h"
+#include "eeprom.h"
+
+#if TRACE
+
+#if BUS_ADDRESS
+#error "the trace is dumped on the service port, a door on the bus has none"
+#endif
+#if SLEEP_MODE == 2
+#error "the byte or key which wakes the lock from power-down is not traced"
+#endif
+#if TRACE_RING & (TRACE_RING - 1)
+#error "TRACE_RING has to be a power of 2"
+#endif
+
+//record ring, written from the tick, the UART and EEPROM interrupts and the
+//main loop, so every record is appended in an atomic block, TRACE_send()
+//frees the bytes it sent
+static volatile unsigned char TRACE_ring[TRACE_RING];
+static volatile unsigned int TRACE_head, TRACE_tail;
+static unsigned long TRACE_last; //time of the newest record
+static unsigned long TRACE_base; //time of the newest record sent
+static unsigned int TRACE_dropped; //records since the previous frame
+static unsigned int TRACE_open; //data of the TX record of TRACE_last, TRACE_RING if none
+static unsigned char TRACE_out; //output PORT last traced
+static unsigned char TRACE_rows[4]; //last sample of every column
+static unsigned char TRACE_silent; //a frame is being sent
+static unsigned char TRACE_crc; //CRC-8 of the bytes sent since the boot
+
+void TRACE_init(void){
+	unsigned char i;
+	TRACE_head = 0;
+	TRACE_tail = 0;
+	TRACE_last = 0;
+	TRACE_base = 0;
+	TRACE_dropped = 0;
+	TRACE_open = TRACE_RING;
+	TRACE_out = 0;
+	TRACE_silent = 0;
+	TRACE_crc = 0;
+	for(i = 0; i < 4; i++){
+		TRACE_rows[i] = 0;
+	}
+}
+
+static void TRACE_put(unsigned char b){
+	TRACE_ring[TRACE_head] = b;
+	TRACE_head = (TRACE_head + 1) & (TRACE_RING - 1);
+}
+
+static unsigned int TRACE_record(unsigned char type, const unsigned char* data, unsigned char len){
+
+	//TRACE_record() appends a record, called in an atomic block, returns the
+	//ring index of its data or TRACE_RING if it was dropped
+
+	unsigned long now = TICK_now(), delta = now - TRACE_last;
+	unsigned char size = delta < TRACE_DELTA ? 1 : delta <= 0xFFFF ? 3 : 5, i;
+	unsigned int at;
+	TRACE_open = TRACE_RING;
+	if(((TRACE_tail - TRACE_head - 1) & (TRACE_RING - 1)) < size + len){
+		TRACE_dropped++; //the next record carries the time since the last one kept
+		return TRACE_RING;
+	}
+	if(size == 1){
+		TRACE_put(type << 5 | delta);
+	}
+	else if(size == 3){
+		TRACE_put(type << 5 | TRACE_DELTA);
+		TRACE_put(delta);
+		TRACE_put(delta >> 8);
+	}
+	else{
+		TRACE_put(type << 5 | TRACE_TIME);
+		for(i = 0; i < 4; i++){
+			TRACE_put(now >> (i * 8));
+		}
+	}
+	at = TRACE_head;
+	for(i = 0; i < len; i++){
+		TRACE_put(data[i]);
+	}
+	TRACE_last = now;
+	return at;
+}
+
+void TRACE_key(unsigned char column, unsigned char rows){
+	//keypad scanner in the tick, rows of the column it read
+	unsigned char data = column << 4 | rows;
+	if(rows != TRACE_rows[column]){
+		TRACE_rows[column] = rows;
+		HAL_ATOMIC{
+			TRACE_record(TRACE_KEY, &data, 1);
+		}
+	}
+}
+
+void TRACE_rx(unsigned char c){
+	HAL_ATOMIC{
+		TRACE_record(TRACE_RX, &c, 1);
+	}
+}
+
+void TRACE_tx(unsigned char c){
+
+	//the bytes of one millisecond go into one record, its count and CRC are
+	//updated in place as long as no other record came in between, the CRC
+	//runs over the whole stream, so the replay compares it however the bytes
+	//are split into records
+
+	unsigned char data[2];
+	unsigned int at;
+	if(TRACE_silent){
+		return;
+	}
+	HAL_ATOMIC{
+		TRACE_crc = FRAME_crc8(TRACE_crc, c);
+		at = TRACE_open;
+		if(at != TRACE_RING && TRACE_last == TICK_now() && TRACE_ring[at] < 0xFF){
+			TRACE_ring[at]++;
+			TRACE_ring[(at + 1) & (TRACE_RING - 1)] = TRACE_crc;
+		}
+		else{
+			data[0] = 1;
+			data[1] = TRACE_crc;
+			TRACE_open = TRACE_record(TRACE_TX, data, 2);
+		}
+	}
+}
+
+void TRACE_eeprom(unsigned int addr, unsigned char old, unsigned char data){
+	//EEPROM ready interrupt, a write cycle starts
+	unsigned char d[4];
+	d[0] = addr;
+	d[1] = addr >> 8;
+	d[2] = old;
+	d[3] = data;
+	HAL_ATOMIC{
+		TRACE_record(TRACE_EEPROM, d, 4);
+	}
+}
+
+void TRACE_tick(void){
+	//output PORT, sampled before every tick and every skip, so a change is
+	//stamped with the millisecond of the main loop which made it
+	unsigned char out = HAL_out_get();
+	if(out != TRACE_out){
+		TRACE_out = out;
+		HAL_ATOMIC{
+			TRACE_record(TRACE_OUT, &out, 1);
+		}
+	}
+}
+
+void TRACE_lcd(unsigned char cell, unsigned char c){
+	//character sent to the LCD controller
+	unsigned char data[2];
+	data[0] = cell;
+	data[1] = c;
+	HAL_ATOMIC{
+		TRACE_record(TRACE_LCD, data, 2);
+	}
+}
+
+void TRACE_quiet(unsigned char on){
+	//bytes of a frame are not traced
+	TRACE_silent = on;
+}
+
+void TRACE_send(void){
+
+	//TRACE_send() sends the records in the ring when it is called, records
+	//added while the frame goes out stay for the next one
+
+	unsigned int n, i, tail, dropped;
+	unsigned long base, last;
+	HAL_ATOMIC{
+		tail = TRACE_tail;
+		n = (TRACE_head - tail) & (TRACE_RING - 1);
+		dropped = TRACE_dropped;
+		TRACE_dropped = 0;
+		TRACE_open = TRACE_RING; //a TX record in the frame is closed
+		last = TRACE_last;
+	}
+	base = TRACE_base;
+	TRACE_base = last;
+	FRAME_begin(FRAME_TRACE, 10 + n);
+	FRAME_long(TICK_now());
+	FRAME_long(base);
+	FRAME_word(dropped);
+	for(i = 0; i < n; i++){
+		FRAME_byte(TRACE_ring[(tail + i) & (TRACE_RING - 1)]);
+	}
+	FRAME_end();
+	HAL_ATOMIC{
+		TRACE_tail = (tail + n) & (TRACE_RING - 1);
+	}
+}
+
+unsigned char TRACE_requested(const char* line, unsigned char len){
+	return len == 6 && memcmp(line, "#TRACE", 6) == 0;
+}
+
+void TRACE_image(void){
+	//EEPROM as the firmware sees it, queued bytes included
+	int addr;
+	FRAME_begin(FRAME_EEPROM, 0x400);
+	for(addr = 0; addr < 0x400; addr++){
+		FRAME_byte(EEPROM_read(addr));
+	}
+	FRAME_end();
+}
+
+unsigned char TRACE_image_requested(const char* line, unsigned char len){
+	return len == 7 && memcmp(line, "#EEPROM", 7) == 0;
+}
+
+#endif
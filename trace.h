@@ -0,0 +1,66 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+//input trace for the replay on the host (host/trace_replay.c)
+//from the first tick the inputs of the lock, the raw keypad samples and the
+//received UART bytes, and its outputs, the output PORT (relay, buzzer, LEDs),
+//the LCD cells, the EEPROM writes and the sent UART bytes, are appended as
+//records to a RAM ring of TRACE_RING bytes, the line "#TRACE" on the service
+//port sends the ring as one binary frame (frame.h) and empties it, so a
+//service tool which asks every few hundred milliseconds gets every record
+//since the boot, a record which does not fit a full ring is dropped and
+//counted, the line "#EEPROM" sends the EEPROM image, the replay takes the
+//EEPROM writes of the trace back from it to get the image at the boot
+//record: header byte, type (bits 5 - 7) and time since the previous record
+//(bits 0 - 4, 0 - 29 ms, 30: 2 more bytes, 31: 4 more bytes, time in ms since
+//boot), then the time bytes and the data of the type, little endian
+//a keypad sample is traced when the rows of a column differ from the previous
+//sample of the column, the bytes sent in one millisecond are traced as their
+//count and the CRC-8 (frame.h) of every byte sent since the boot, the replay
+//sends them again, so it compares them without the bytes in the ring, frames
+//sent on the service port are not traced, the replay sends them again as well
+//frame FRAME_TRACE payload: uptime ms (4), time of the record before the
+//first one (4), records dropped since the previous frame (2), records
+//frame FRAME_EEPROM payload: the 1024 EEPROM bytes
+
+//record types and their data
+#define TRACE_KEY 0 //column << 4 | rows (bit 0 = row 1)
+#define TRACE_RX 1 //received byte
+#define TRACE_TX 2 //bytes sent, CRC-8 of the stream up to the last one
+#define TRACE_EEPROM 3 //address (2), old value, new value
+#define TRACE_OUT 4 //output PORT
+#define TRACE_LCD 5 //cell (row * 16 + column), character
+#define TRACE_TYPES 6
+
+#define TRACE_DELTA 30 //header delta of a 2 byte time
+#define TRACE_TIME 31 //header delta of a 4 byte time
+
+#if TRACE
+void TRACE_init(void);
+void TRACE_key(unsigned char column, unsigned char rows);
+void TRACE_rx(unsigned char c);
+void TRACE_tx(unsigned char c);
+void TRACE_eeprom(unsigned int addr, unsigned char old, unsigned char data);
+void TRACE_tick(void);
+void TRACE_lcd(unsigned char cell, unsigned char c);
+void TRACE_quiet(unsigned char on);
+void TRACE_send(void);
+unsigned char TRACE_requested(const char* line, unsigned char len);
+void TRACE_image(void);
+unsigned char TRACE_image_requested(const char* line, unsigned char len);
+#else
+#define TRACE_init()
+#define TRACE_key(column, rows)
+#define TRACE_rx(c)
+#define TRACE_tx(c)
+#define TRACE_eeprom(addr, old, data)
+#define TRACE_tick()
+#define TRACE_lcd(cell, c)
+#define TRACE_quiet(on)
+#define TRACE_send()
+#define TRACE_requested(line, len) 0
+#define TRACE_image()
+#define TRACE_image_requested(line, len) 0
+#endif
+
+#endif
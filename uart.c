@@ -0,0 +1,124 @@
+//included libraries
+#include "config.h"
+#include "hal.h"
+#include "uart.h"
+#include "sched.h"
+#include "telem.h"
+#include "trace.h"
+
+//transmit ring, UART_head is written only by the main loop and UART_tail only
+//by the data register empty interrupt
+static volatile unsigned char UART_ring[UART_TX_QUEUE];
+static volatile unsigned char UART_head, UART_tail;
+
+//receive ring, UART_rx_head is written only by the receive complete interrupt
+//and UART_rx_tail only by the main loop
+static volatile unsigned char UART_rx_ring[UART_RX_QUEUE];
+static volatile unsigned char UART_rx_head, UART_rx_tail;
+static volatile unsigned int UART_rx_overrun; //bytes lost on a full ring
+
+void UART_init(long UART_BAUDRATE){
+	UART_head = 0;
+	UART_tail = 0;
+	UART_rx_head = 0;
+	UART_rx_tail = 0;
+	UART_rx_overrun = 0;
+	HAL_uart_init(UART_BAUDRATE);
+}
+
+void UART_send_char(unsigned char a){
+	//enqueue one byte, the call waits only while the ring is full
+	unsigned char next = (UART_head + 1) & (UART_TX_QUEUE - 1);
+	TELEM_BEGIN(start);
+	while(next == UART_tail){ //wait for the interrupt to free a slot
+		HAL_spin();
+	}
+	UART_ring[UART_head] = a;
+	UART_head = next; //publish the byte after it is stored
+	TRACE_tx(a);
+	HAL_uart_tx_start(); //enable data register empty interrupt
+	TELEM_END(TELEM_UART, start);
+}
+
+void UART_send_string(const char* string){
+	while(*string != 0){
+		UART_send_char(*string++);
+	}
+}
+
+void UART_send_string_P(const char* string){
+	//string in flash (HAL_PSTR)
+	char c;
+	while((c = HAL_flash_byte(string++)) != 0){
+		UART_send_char(c);
+	}
+}
+
+void UART_send_number(unsigned long n){
+	//send n as decimal text
+	char digits[10];
+	unsigned char i = 0;
+	do{
+		digits[i++] = '0' + n % 10;
+		n /= 10;
+	}
+	while(n != 0);
+	while(i > 0){
+		UART_send_char(digits[--i]);
+	}
+}
+
+unsigned char UART_tx_free(void){
+	//number of bytes which can be enqueued without waiting
+	return (UART_tail - UART_head - 1) & (UART_TX_QUEUE - 1);
+}
+
+unsigned char UART_tx_idle(void){
+	//true if the ring is empty and the last frame has left, checked before
+	//sleeping or switching the line
+	return UART_head == UART_tail && HAL_uart_tx_done();
+}
+
+int UART_tx_next(void){
+	//called from the data register empty interrupt, returns the next byte to
+	//send or -1 if the ring is empty
+	unsigned char c;
+	if(UART_tail == UART_head){
+		return -1;
+	}
+	c = UART_ring[UART_tail];
+	UART_tail = (UART_tail + 1) & (UART_TX_QUEUE - 1);
+	return c;
+}
+
+unsigned char UART_receive(unsigned char* c){
+	//take the oldest received byte, returns 0 if nothing was received
+	if(UART_rx_tail == UART_rx_head){
+		return 0;
+	}
+	*c = UART_rx_ring[UART_rx_tail];
+	UART_rx_tail = (UART_rx_tail + 1) & (UART_RX_QUEUE - 1); //free the slot
+	return 1;
+}
+
+unsigned int UART_rx_lost(void){
+	unsigned int lost;
+	HAL_ATOMIC{
+		lost = UART_rx_overrun;
+	}
+	return lost;
+}
+
+void UART_rx_byte(unsigned char c){
+	//called from the receive complete interrupt, the byte is stored in the
+	//receive ring
+	unsigned char next = (UART_rx_head + 1) & (UART_RX_QUEUE - 1);
+	TRACE_rx(c);
+	if(next == UART_rx_tail){
+		UART_rx_overrun++; //ring is full, main loop did not keep up
+		return;
+	}
+	UART_rx_ring[UART_rx_head] = c;
+	UART_rx_head = next;
+	SCHED_signal(SCHED_RX); //let the main loop process the byte
+}
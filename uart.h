@@ -0,0 +1,21 @@
+#ifndef UART_H
+#define UART_H
+
+//buffered, interrupt driven UART transmitter
+//UART_send_char() and UART_send_string() only copy bytes into the transmit
+//ring, the USART data register empty interrupt sends them, so a caller waits
+//only if the ring is full, UART_tx_idle() tells when the last byte has left
+//received bytes are stored by the receive complete interrupt into the receive
+//ring and taken out with UART_receive()
+
+void UART_init(long UART_BAUDRATE);
+void UART_send_char(unsigned char a);
+void UART_send_string(const char* string);
+void UART_send_string_P(const char* string);
+void UART_send_number(unsigned long n);
+unsigned char UART_tx_free(void);
+unsigned char UART_tx_idle(void);
+unsigned char UART_receive(unsigned char* c);
+unsigned int UART_rx_lost(void);
+
+#endif